@@ -20,13 +20,149 @@ and conditions of your Software License Agreement
 #define CLIP_U8(x) CLIP3((x), 0, 255)
 #define CLIP_S16(x) CLIP3((x), -32768, 32767)
 
+// Depth-specific vector access. The vector kernels load pixels widened to 16-bit
+// lanes and store 16-bit lanes through these helpers, so the arithmetic between
+// them is written once for every BIT_DEPTH.
+
+// eight pixels widened to 16-bit lanes
+static uhd_always_inline uint16x8_t FUNC(load_pixels8)(const pixel *src)
+{
+#if BIT_DEPTH > 8
+    return vld1q_u16(src);
+#else
+    return vmovl_u8(vld1_u8(src));
+#endif
+}
+
+// stores eight lanes; 8-bit narrows with saturation, deeper lanes must
+// already be inside the pixel range
+static uhd_always_inline void FUNC(store_pixels8)(pixel *dst, uint16x8_t v)
+{
+#if BIT_DEPTH > 8
+    vst1q_u16(dst, v);
+#else
+    vst1_u8(dst, vqmovn_u16(v));
+#endif
+}
+
+static uhd_always_inline int16x8_t FUNC(pel_load8)(const pixel *src)
+{
+    return vreinterpretq_s16_u16(FUNC(load_pixels8)(src));
+}
+
+// store_pixels8 with a non-temporal hint: the eight pixels leave as one STNP
+// pair, so write-once output does not evict reference samples from the cache
+static uhd_always_inline void FUNC(store_pixels8_nt)(pixel *dst, uint16x8_t v)
+{
+#if defined(__aarch64__) && BIT_DEPTH > 8
+    __asm__ volatile("stnp %d1, %d2, [%0]" : : "r"(dst), "w"(vget_low_u16(v)), "w"(vget_high_u16(v)) : "memory");
+#elif defined(__aarch64__)
+    uint32x2_t w = vreinterpret_u32_u8(vqmovn_u16(v));
+
+    __asm__ volatile("stnp %s1, %s2, [%0]" : : "r"(dst), "w"(w), "w"(vdup_lane_u32(w, 1)) : "memory");
+#else
+    FUNC(store_pixels8)(dst, v);
+#endif
+}
+
+// The store hook of the kernels that write picture samples. nt is a constant
+// at every call site: 0 in the plain kernel, 1 in its _nt variant.
+static uhd_always_inline void FUNC(store_pixels8_hint)(pixel *dst, uint16x8_t v, int nt)
+{
+    if (nt)
+    {
+        FUNC(store_pixels8_nt)(dst, v);
+    }
+    else
+    {
+        FUNC(store_pixels8)(dst, v);
+    }
+}
+
+// clips eight lanes to the pixel range and stores them
+static uhd_always_inline void FUNC(pel_store8_hint)(pixel *dst, int16x8_t v, int nt)
+{
+    v = vminq_s16(vmaxq_s16(v, vdupq_n_s16(0)), vdupq_n_s16((1 << BIT_DEPTH) - 1));
+    FUNC(store_pixels8_hint)(dst, vreinterpretq_u16_s16(v), nt);
+}
+
+static uhd_always_inline void FUNC(pel_store8)(pixel *dst, int16x8_t v)
+{
+    FUNC(pel_store8_hint)(dst, v, 0);
+}
+
+#ifndef UHD_PUT_ROW
+// The row store of the scalar kernels: dst[x] = expr for x = 0 .. width - 1,
+// with x the caller's loop variable. Under nt the values are gathered eight
+// at a time and leave through store_pixels8_hint; the tail is stored as is.
+#define UHD_PUT_ROW(dst, width, nt, x, expr)                                              \
+    do                                                                                    \
+    {                                                                                     \
+        x = 0;                                                                            \
+        if (nt)                                                                           \
+        {                                                                                 \
+            while (x + 8 <= (width))                                                      \
+            {                                                                             \
+                uint16_t put_row_lanes[8];                                                \
+                int put_row_x = x;                                                        \
+                                                                                          \
+                for (; x < put_row_x + 8; x++)                                            \
+                {                                                                         \
+                    put_row_lanes[x - put_row_x] = (expr);                                \
+                }                                                                         \
+                FUNC(store_pixels8_hint)((dst) + put_row_x, vld1q_u16(put_row_lanes), 1); \
+            }                                                                             \
+        }                                                                                 \
+        for (; x < (width); x++)                                                          \
+        {                                                                                 \
+            (dst)[x] = (expr);                                                            \
+        }                                                                                 \
+    } while (0)
+#endif
+
+// fills n pixels with v, a vector register at a time
+static uhd_always_inline void FUNC(emulated_edge_fill)(pixel *dst, pixel v, int n)
+{
+    int x = 0;
+
+#if BIT_DEPTH > 8
+    uint16x8_t vec = vdupq_n_u16(v);
+
+    for (; x + 8 <= n; x += 8)
+    {
+        vst1q_u16(dst + x, vec);
+    }
+    if (x + 4 <= n)
+    {
+        vst1_u16(dst + x, vget_low_u16(vec));
+        x += 4;
+    }
+#else
+    uint8x16_t vec = vdupq_n_u8(v);
+
+    for (; x + 16 <= n; x += 16)
+    {
+        vst1q_u8(dst + x, vec);
+    }
+    if (x + 8 <= n)
+    {
+        vst1_u8(dst + x, vget_low_u8(vec));
+        x += 8;
+    }
+#endif
+    for (; x < n; x++)
+    {
+        dst[x] = v;
+    }
+}
+
 static inline void FUNC(uhd_emulated_edge_mc)(uint8_t *buf, const uint8_t *src,
                                               ptrdiff_t buf_linesize,
                                               ptrdiff_t src_linesize,
                                               int block_w, int block_h,
                                               int src_x, int src_y, int w, int h)
 {
-    int x, y;
+    int y;
     int start_y, start_x, end_y, end_x;
 
     if (!w || !h)
@@ -68,47 +204,139 @@ static inline void FUNC(uhd_emulated_edge_mc)(uint8_t *buf, const uint8_t *src,
 
     w = end_x - start_x;
     src += start_y * src_linesize + start_x * sizeof(pixel);
-    buf += start_x * sizeof(pixel);
 
+    // rows with source samples: broadcast the edge pixels around a plain copy
+    for (y = start_y; y < end_y; y++)
+    {
+        pixel *bufp = (pixel *)(buf + y * buf_linesize);
+        const pixel *srcp = (const pixel *)src;
+
+        FUNC(emulated_edge_fill)(bufp, srcp[0], start_x);
+        memcpy(bufp + start_x, srcp, w * sizeof(pixel));
+        FUNC(emulated_edge_fill)(bufp + end_x, srcp[w - 1], block_w - end_x);
+        src += src_linesize;
+    }
+
+    // rows above and below replicate the first and last padded row whole
     for (y = 0; y < start_y; y++)
     {
-        memcpy(buf, src, w * sizeof(pixel));
-        buf += buf_linesize;
+        memcpy(buf + y * buf_linesize, buf + start_y * buf_linesize, block_w * sizeof(pixel));
     }
 
-    for (; y < end_y; y++)
+    for (y = end_y; y < block_h; y++)
     {
-        memcpy(buf, src, w * sizeof(pixel));
-        src += src_linesize;
-        buf += buf_linesize;
+        memcpy(buf + y * buf_linesize, buf + (end_y - 1) * buf_linesize, block_w * sizeof(pixel));
     }
+}
+
+#ifndef UHD_FRAME_PAD_HELPERS
+#define UHD_FRAME_PAD_HELPERS
+// Border replicated around a reference picture by uhd_pad_frame: a MAX_PB_SIZE
+// block plus the qpel taps, so in-picture MVs never need uhd_emulated_edge_mc.
+// A build may predefine it.
+#ifndef UHD_FRAME_PADDING
+#define UHD_FRAME_PADDING 80
+#endif
+
+// nonzero when the block_w x block_h read at (x, y), filter taps included,
+// leaves the picture widened by pad pixels on every side
+static inline int uhd_mc_needs_edge_emu(int x, int y, int block_w, int block_h, int w, int h, int pad)
+{
+    return x < -pad || y < -pad || x + block_w > w + pad || y + block_h > h + pad;
+}
+#endif
+
+// Replicates the outer rows and columns of a decoded w x h picture into the
+// pad-pixel border around it; data points at the first picture sample and the
+// buffer must hold pad extra pixels on each side. Run once per reference
+// picture after the in-loop filters.
+static void FUNC(uhd_pad_frame)(uint8_t *data, ptrdiff_t linesize, int w, int h, int pad)
+{
+    int y;
+    uint8_t *top = data - pad * sizeof(pixel);
+    uint8_t *bottom = top + (h - 1) * linesize;
+    size_t row_size = (w + 2 * pad) * sizeof(pixel);
 
-    src -= src_linesize;
-    for (; y < block_h; y++)
+    for (y = 0; y < h; y++)
     {
-        memcpy(buf, src, w * sizeof(pixel));
-        buf += buf_linesize;
+        pixel *row = (pixel *)(data + y * linesize);
+
+        FUNC(emulated_edge_fill)(row - pad, row[0], pad);
+        FUNC(emulated_edge_fill)(row + w, row[w - 1], pad);
     }
 
-    buf -= block_h * buf_linesize + start_x * sizeof(pixel);
-    while (block_h--)
+    for (y = 1; y <= pad; y++)
     {
-        pixel *bufp = (pixel *)buf;
+        memcpy(top - y * linesize, top, row_size);
+        memcpy(bottom + y * linesize, bottom, row_size);
+    }
+}
+
+#if BIT_DEPTH < 16
+// Unpacks a byte-aligned 8- or 10-bit PCM block straight from the bitstream
+// buffer, 8 samples per step; width must be a multiple of 8.
+static void FUNC(put_pcm_bulk)(pixel *dst, ptrdiff_t stride, int width, int height,
+                               const uint8_t *src, int pcm_bit_depth)
+{
+    int x, y;
 
-        for (x = 0; x < start_x; x++)
+    if (pcm_bit_depth == 8)
+    {
+        for (y = 0; y < height; y++)
         {
-            bufp[x] = bufp[start_x];
+            for (x = 0; x < width; x += 8)
+            {
+#if BIT_DEPTH > 8
+                vst1q_u16(dst + x, vshll_n_u8(vld1_u8(src + x), BIT_DEPTH - 8));
+#else
+                vst1_u8(dst + x, vld1_u8(src + x));
+#endif
+            }
+            src += width;
+            dst += stride;
         }
+        return;
+    }
+
+#if BIT_DEPTH >= 10
+    // 8 samples span 10 bytes; sample i sits in the big-endian byte pair starting
+    // at byte 10 * i / 8, (6 - 10 * i % 8) bits above the bottom
+    static const uint8_t pair_idx[16] = { 1, 0, 2, 1, 3, 2, 4, 3, 6, 5, 7, 6, 8, 7, 9, 8 };
+    static const int16_t pair_shift[8] = { -6, -4, -2, 0, -6, -4, -2, 0 };
+    uint8x16_t idx = vld1q_u8(pair_idx);
+    int16x8_t shift = vld1q_s16(pair_shift);
+    uint16x8_t mask = vdupq_n_u16(0x3ff);
+    const uint8_t *end = src + width * height * 10 / 8;
+    uint8_t last[16];
 
-        for (x = end_x; x < block_w; x++)
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x += 8)
         {
-            bufp[x] = bufp[end_x - 1];
+            uint8x16_t bytes;
+
+            // the load covers 16 bytes; never read past the PCM payload
+            if (src + 16 <= end)
+            {
+                bytes = vld1q_u8(src);
+            }
+            else
+            {
+                memcpy(last, src, 10);
+                bytes = vld1q_u8(last);
+            }
+
+            uint16x8_t pairs = vreinterpretq_u16_u8(vqtbl1q_u8(bytes, idx));
+            uint16x8_t samples = vandq_u16(vshlq_u16(pairs, shift), mask);
+
+            vst1q_u16(dst + x, vshlq_n_u16(samples, BIT_DEPTH - 10));
+            src += 10;
         }
-        buf += buf_linesize;
+        dst += stride;
     }
+#endif
 }
 
-#if BIT_DEPTH < 16
 static void FUNC(put_pcm)(uint8_t *_dst, ptrdiff_t stride, int width, int height,
                           GetBitContext *gb, int pcm_bit_depth)
 {
@@ -117,6 +345,17 @@ static void FUNC(put_pcm)(uint8_t *_dst, ptrdiff_t stride, int width, int height
 
     stride /= sizeof(pixel);
 
+    // pcm_sample() follows pcm_alignment_zero_bits, so the reader is normally
+    // byte aligned and the common depths can be unpacked in bulk
+    if (!(get_bits_count(gb) & 7) && !(width & 7) &&
+        (pcm_bit_depth == 8 || (pcm_bit_depth == 10 && BIT_DEPTH >= 10)))
+    {
+        FUNC(put_pcm_bulk)(dst, stride, width, height,
+                           gb->buffer + (get_bits_count(gb) >> 3), pcm_bit_depth);
+        skip_bits_long(gb, width * height * pcm_bit_depth);
+        return;
+    }
+
     for (y = 0; y < height; y++)
     {
         for (x = 0; x < width; x++)
@@ -413,392 +652,3223 @@ IDCT_DC(8)
 IDCT_DC(16)
 IDCT_DC(32)
 
-#undef TR_4
-#undef TR_8
-#undef TR_16
-#undef TR_32
+// Dequantization of the parsed levels of a TU, in place in the raster
+// order buffer that idct_NxN reads. qp includes the bit-depth offset. sm
+// is the scaling list of the TU, or NULL for the flat factor 16 (and for
+// transform skip above 4x4). It holds 16 entries for 4x4 and 64 for 8x8.
+// For 16x16 and 32x32 its 64 entries are upsampled, and sm_dc replaces
+// the DC factor. level_scale[qp % 6] times the factor fits 16 bits.
+// qp / 6 is folded into the final shift, so the products stay in 32 bits.
+#ifndef UHD_DEQUANT
+#define UHD_DEQUANT
+static const uint8_t uhd_level_scale[6] = {40, 45, 51, 57, 64, 72};
+
+// the scaling-list factor of column x, row y
+static uhd_always_inline int uhd_dequant_m(const uint8_t *sm, int sm_dc, int log2_size, int x, int y)
+{
+    int rep = log2_size - 3;
+
+    if (!sm)
+        return 16;
+    if (log2_size == 2)
+        return sm[4 * y + x];
+    if (rep && !(x | y))
+        return sm_dc;
+    return sm[8 * (y >> rep) + (x >> rep)];
+}
 
-#undef SET
-#undef SCALE
-#undef ADD_AND_SCALE
+// (c * scale + (1 << (shift - 1))) >> shift, clipped to 16 bits; shift
+// may be zero or negative, which is a left shift
+static uhd_always_inline int uhd_dequant_coeff(int c, int scale, int shift)
+{
+    int v = c * scale;
 
-static void FUNC(sao_band_filter)(uint8_t *_dst, uint8_t *_src,
-                                  ptrdiff_t stride_dst, ptrdiff_t stride_src,
-                                  int16_t *sao_offset_val, int sao_left_class,
-                                  int width, int height)
+    if (shift > 0)
+        return uhd_clip_int16((v + (1 << (shift - 1))) >> shift);
+    return uhd_clip_int16(uhd_clip_int16(v) * (1 << -shift));
+}
+
+static uhd_always_inline int16x8_t uhd_dequant8(int16x8_t c, int16x8_t scale, int32x4_t shift)
 {
-    pixel *dst = (pixel *)_dst;
-    pixel *src = (pixel *)_src;
-    int offset_table[32] = {0};
-    int k, y, x;
-    int shift = BIT_DEPTH - 5;
+    int32x4_t lo = vqrshlq_s32(vmull_s16(vget_low_s16(c), vget_low_s16(scale)), shift);
+    int32x4_t hi = vqrshlq_s32(vmull_high_s16(c, scale), shift);
 
-    stride_dst /= sizeof(pixel);
-    stride_src /= sizeof(pixel);
+    return vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi));
+}
+#endif
 
-    for (k = 0; k < 4; k++)
-    {
-        offset_table[(k + sao_left_class) & 31] = sao_offset_val[k + 1];
-    }
-    for (y = 0; y < height; y++)
+#define VECTOR_DEQUANT
+
+// scalar reference, built with either toggle so the auto-tuner can time it
+static void FUNC(dequant_c)(int16_t *coeffs, int log2_size, int qp, const uint8_t *sm, int sm_dc)
+{
+    int size = 1 << log2_size;
+    int scale = uhd_level_scale[qp % 6];
+    int shift = BIT_DEPTH + log2_size - 5 - qp / 6;
+    int x, y;
+
+    for (y = 0; y < size; y++)
     {
-        for (x = 0; x < width; x++)
+        for (x = 0; x < size; x++)
         {
-            dst[x] = uhd_clip_pixel(src[x] + offset_table[src[x] >> shift]);
+            *coeffs = uhd_dequant_coeff(*coeffs, scale * uhd_dequant_m(sm, sm_dc, log2_size, x, y), shift);
+            coeffs++;
         }
-        dst += stride_dst;
-        src += stride_src;
     }
 }
 
-#define VECTOR_SAO
-
-#define CMP(a, b) (((a) > (b)) - ((a) < (b)))
-
-static void FUNC(sao_edge_filter)(uint8_t *_dst, uint8_t *_src, ptrdiff_t stride_dst, int16_t *sao_offset_val,
-                                  int eo, int width, int height)
+static void FUNC(dequant)(int16_t *coeffs, int log2_size, int qp, const uint8_t *sm, int sm_dc)
 {
+#ifdef SCALAR_DEQUANT
+    FUNC(dequant_c)(coeffs, log2_size, qp, sm, sm_dc);
+#endif
 
-    static const uint8_t edge_idx[] = {1, 2, 0, 3, 4};
-    static const int8_t pos[4][2][2] =
-        {
-            {{-1, 0}, {1, 0}},  // horizontal
-            {{0, -1}, {0, 1}},  // vertical
-            {{-1, -1}, {1, 1}}, // 45 degree
-            {{1, -1}, {-1, 1}}, // 135 degree
-        };
-    pixel *dst = (pixel *)_dst;
-    pixel *src = (pixel *)_src;
-    int a_stride, b_stride;
+#ifdef VECTOR_DEQUANT
+    int size = 1 << log2_size;
+    int scale = uhd_level_scale[qp % 6];
+    int shift = BIT_DEPTH + log2_size - 5 - qp / 6;
+    int32x4_t sh = vdupq_n_s32(-shift);
     int x, y;
-    ptrdiff_t stride_src = (2 * MAX_PB_SIZE + UHD_INPUT_BUFFER_PADDING_SIZE) / sizeof(pixel);
-    stride_dst /= sizeof(pixel);
-
-    a_stride = pos[eo][0][0] + pos[eo][0][1] * (int)stride_src;
-    b_stride = pos[eo][1][0] + pos[eo][1][1] * (int)stride_src;
 
-#ifdef SCALAR_SAO
-    for (y = 0; y < height; y++)
+    if (!sm)
     {
-        for (x = 0; x < width; x++)
+        int16x8_t s = vdupq_n_s16(16 * scale);
+
+        for (x = 0; x < size * size; x += 8)
         {
-            int diff0 = CMP(src[x], src[x + a_stride]);
-            int diff1 = CMP(src[x], src[x + b_stride]);
-            int offset_val = edge_idx[2 + diff0 + diff1];
-            dst[x] = uhd_clip_pixel(src[x] + sao_offset_val[offset_val]);
+            vst1q_s16(coeffs + x, uhd_dequant8(vld1q_s16(coeffs + x), s, sh));
         }
-        src += stride_src;
-        dst += stride_dst;
     }
-#endif
-
-#ifdef VECTOR_SAO
-    for (y = 0; y < height; y++)
+    else if (log2_size == 2)
     {
-        for (x = 0; x < width; x += 8)
-        {
-// for bit_depth > 8 the if block will be executed otherwise it will go to else part of src loading
-#if BIT_DEPTH > 8
-            uint16x8_t src0 = vld1q_u16(src + x);
-            uint16x8_t src1 = vld1q_u16(src + x + a_stride);
-            uint16x8_t src2 = vld1q_u16(src + x + b_stride);
-#else
-            uint16x8_t src0 = vmovl_u8(vld1_u8(src + x));
-            uint16x8_t src1 = vmovl_u8(vld1_u8(src + x + a_stride));
-            uint16x8_t src2 = vmovl_u8(vld1_u8(src + x + b_stride));
-#endif
-
-            // computes a>b - a<b to calculate diff0 and diff1
-            uint16x8_t gt0 = vcgtq_u16(src0, src1);
-            uint16x8_t lt0 = vcltq_u16(src0, src1);
-            uint16x8_t gt1 = vcgtq_u16(src0, src2);
-            uint16x8_t lt1 = vcltq_u16(src0, src2);
-
-            int8x8_t diff0 = vmovn_s16(vreinterpretq_s16_u16(vsubq_u16(lt0, gt0)));
-            int8x8_t diff1 = vmovn_s16(vreinterpretq_s16_u16(vsubq_u16(lt1, gt1)));
-
-            // calculating offset value
-            int8x8_t edge_index = vreinterpret_s8_u8(vld1_u8(edge_idx));
-            int8x8_t ed_pos = vadd_s8(vadd_s8(vdup_n_s8(2), diff0), diff1);
-            int8x8_t off_val = vtbl1_s8(edge_index, ed_pos);
+        uint8x16_t m = vld1q_u8(sm);
+        int16x8_t s0 = vreinterpretq_s16_u16(vmulq_n_u16(vmovl_u8(vget_low_u8(m)), scale));
+        int16x8_t s1 = vreinterpretq_s16_u16(vmulq_n_u16(vmovl_high_u8(m), scale));
 
-            // calculates sao offset value
-            int16x8_t sao = vld1q_s16(sao_offset_val);
-            int8x8_t s_o = vqmovn_s16(sao);
-            int16x8_t offset = vmovl_s8(vtbl1_s8(s_o, off_val));
+        vst1q_s16(coeffs, uhd_dequant8(vld1q_s16(coeffs), s0, sh));
+        vst1q_s16(coeffs + 8, uhd_dequant8(vld1q_s16(coeffs + 8), s1, sh));
+    }
+    else
+    {
+        // each list entry covers 1 << rep columns and rows
+        int rep = log2_size - 3;
+        int c0 = coeffs[0];
+        int16_t *row = coeffs;
 
-            // adding src and sao offset value
-            int32x4_t f_add0 = vuqaddq_s32(vmovl_s16(vget_low_s16(offset)), vmovl_u16(vget_low_u16(src0)));
-            int32x4_t f_add1 = vuqaddq_s32(vmovl_s16(vget_high_s16(offset)), vmovl_u16(vget_high_u16(src0)));
+        for (y = 0; y < size; y++)
+        {
+            int16x8_t s[4];
 
-            // clipping operation
-            uint16x4_t clip0 = vqmovun_s32(f_add0);
-            uint16x4_t clip1 = vqmovun_s32(f_add1);
+            s[0] = vreinterpretq_s16_u16(vmulq_n_u16(vmovl_u8(vld1_u8(sm + 8 * (y >> rep))), scale));
+            if (rep == 1)
+            {
+                s[1] = vzip2q_s16(s[0], s[0]);
+                s[0] = vzip1q_s16(s[0], s[0]);
+            }
+            else if (rep == 2)
+            {
+                int16x8_t lo = vzip1q_s16(s[0], s[0]);
+                int16x8_t hi = vzip2q_s16(s[0], s[0]);
 
-            uint16x8_t opp = vcombine_u16(clip0, clip1);
-            #if BIT_DEPTH > 8
-                vst1q_u16(dst + x, opp);
-            #else
-            uint8x8_t finale = vqmovn_u16(opp);
-            vst1_u8(dst + x, finale);
-            #endif
+                s[0] = vzip1q_s16(lo, lo);
+                s[1] = vzip2q_s16(lo, lo);
+                s[2] = vzip1q_s16(hi, hi);
+                s[3] = vzip2q_s16(hi, hi);
+            }
+            for (x = 0; x < size; x += 8)
+            {
+                vst1q_s16(row + x, uhd_dequant8(vld1q_s16(row + x), s[x >> 3], sh));
+            }
+            row += size;
+        }
+        if (rep)
+        {
+            coeffs[0] = uhd_dequant_coeff(c0, scale * sm_dc, shift);
         }
-        src += stride_src;
-        dst += stride_dst;
     }
 #endif
 }
 
-static void FUNC(clip_row)(uint8_t *_dst, uint8_t *_src, int width, int offset_val)
-{
-    pixel *dst = (pixel *)_dst;
-    pixel *src = (pixel *)_src;
+#define DEQUANT(H, log2)                                                                 \
+    static void FUNC(dequant_##H##x##H)(int16_t * coeffs, int qp, const uint8_t *sm,     \
+                                        int sm_dc)                                       \
+    {                                                                                    \
+        FUNC(dequant)(coeffs, log2, qp, sm, sm_dc);                                      \
+    }                                                                                    \
+                                                                                         \
+    static void FUNC(dequant_##H##x##H##_c)(int16_t * coeffs, int qp, const uint8_t *sm, \
+                                            int sm_dc)                                   \
+    {                                                                                    \
+        FUNC(dequant_c)(coeffs, log2, qp, sm, sm_dc);                                    \
+    }
 
-    for (int x = 0; x < width; x++)
-    {
-        dst[x] = uhd_clip_pixel(src[x] + offset_val);
+DEQUANT(4, 2)
+DEQUANT(8, 3)
+DEQUANT(16, 4)
+DEQUANT(32, 5)
+
+#undef DEQUANT
+
+// idct_NxN on the undequantized levels. The first pass dequantizes each
+// column as it loads it, up to the same col_limit bound (the rows below it
+// are zero), so the levels go from the parse buffer to the transform in
+// one read.
+#define IDCT_DEQUANT(H, log2)                                                          \
+    static void FUNC(idct_dequant_##H##x##H)(int16_t * coeffs, int col_limit, int qp,  \
+                                             const uint8_t *sm, int sm_dc)             \
+    {                                                                                  \
+        int i, k;                                                                      \
+        int shift = 7;                                                                 \
+        int add = 1 << (shift - 1);                                                    \
+        int scale = uhd_level_scale[qp % 6];                                           \
+        int dq_shift = BIT_DEPTH + log2 - 5 - qp / 6;                                  \
+        int16_t *src = coeffs;                                                         \
+        int16_t col[H];                                                                \
+        IDCT_VAR##H(H);                                                                \
+                                                                                       \
+        for (i = 0; i < H; i++)                                                        \
+        {                                                                              \
+            for (k = 0; k < limit2; k++)                                               \
+                col[k] = uhd_dequant_coeff(src[k * H],                                 \
+                                           scale * uhd_dequant_m(sm, sm_dc, log2, i, k), \
+                                           dq_shift);                                  \
+            for (; k < H; k++)                                                         \
+                col[k] = 0;                                                            \
+            TR_##H(src, col, H, 1, SCALE, limit2);                                     \
+            if (limit2 < H && i % 4 == 0 && !!i)                                       \
+                limit2 -= 4;                                                           \
+            src++;                                                                     \
+        }                                                                              \
+                                                                                       \
+        shift = 20 - BIT_DEPTH;                                                        \
+        add = 1 << (shift - 1);                                                        \
+        for (i = 0; i < H; i++)                                                        \
+        {                                                                              \
+            TR_##H(coeffs, coeffs, 1, 1, SCALE, limit);                                \
+            coeffs += H;                                                               \
+        }                                                                              \
     }
-}
 
-static void FUNC(sao_edge_restore_0)(uint8_t *_dst, uint8_t *_src,
-                                     ptrdiff_t stride_dst, ptrdiff_t stride_src, SAOParams *sao,
-                                     int *borders, int _width, int _height,
-                                     int c_idx, uint8_t *vert_edge,
-                                     uint8_t *horiz_edge, uint8_t *diag_edge, func_clip_row_ptr clip_func)
-{
-    int x, y;
-    pixel *dst = (pixel *)_dst;
-    pixel *src = (pixel *)_src;
-    int16_t *sao_offset_val = sao->offset_val[c_idx];
-    int sao_eo_class = sao->eo_class[c_idx];
-    int width = _width, height = _height;
+IDCT_DEQUANT(4, 2)
+IDCT_DEQUANT(8, 3)
+IDCT_DEQUANT(16, 4)
+IDCT_DEQUANT(32, 5)
+
+#undef IDCT_DEQUANT
+
+// Forward transforms: the transposes of TR_4x4_LUMA and TR_4 .. TR_32, run
+// over the rows of the residual and then its columns with the HM shifts.
+// Each size splits its input into the sums (even outputs, the next size
+// down) and differences (odd outputs) of mirrored samples, and reads the
+// same transform matrix as the inverse.
+#define VECTOR_FDCT
+
+#define FTR_4x4_LUMA(dst, src, step, assign)                          \
+    do                                                                \
+    {                                                                 \
+        int c0 = src[0 * step] + src[3 * step];                       \
+        int c1 = src[1 * step] + src[3 * step];                       \
+        int c2 = src[0 * step] - src[1 * step];                       \
+        int c3 = 74 * src[2 * step];                                  \
+        int c4 = 74 * (src[0 * step] + src[1 * step] - src[3 * step]); \
+                                                                      \
+        assign(dst[0 * step], 29 * c0 + 55 * c1 + c3);                \
+        assign(dst[1 * step], c4);                                    \
+        assign(dst[2 * step], 29 * c2 + 55 * c0 - c3);                \
+        assign(dst[3 * step], 55 * c2 - 29 * c1 + c3);                \
+    } while (0)
 
-    stride_dst /= sizeof(pixel);
-    stride_src /= sizeof(pixel);
+#define FTR_4(dst, src, dstep, sstep, assign)                     \
+    do                                                            \
+    {                                                             \
+        const int e0 = src[0 * sstep] + src[3 * sstep];           \
+        const int e1 = src[1 * sstep] + src[2 * sstep];           \
+        const int o0 = src[0 * sstep] - src[3 * sstep];           \
+        const int o1 = src[1 * sstep] - src[2 * sstep];           \
+                                                                  \
+        assign(dst[0 * dstep], 64 * e0 + 64 * e1);                \
+        assign(dst[1 * dstep], 83 * o0 + 36 * o1);                \
+        assign(dst[2 * dstep], 64 * e0 - 64 * e1);                \
+        assign(dst[3 * dstep], 36 * o0 - 83 * o1);                \
+    } while (0)
 
-    if (sao_eo_class != SAO_EO_HORIZ)
+#define FTR_8(dst, src, dstep, sstep, assign)                   \
+    do                                                          \
+    {                                                           \
+        int i, j;                                               \
+        int e_8[4];                                             \
+        int o_8[4];                                             \
+        for (i = 0; i < 4; i++)                                 \
+        {                                                       \
+            e_8[i] = src[i * sstep] + src[(7 - i) * sstep];     \
+            o_8[i] = src[i * sstep] - src[(7 - i) * sstep];     \
+        }                                                       \
+        FTR_4(dst, e_8, 2 * dstep, 1, assign);                  \
+                                                                \
+        for (i = 1; i < 8; i += 2)                              \
+        {                                                       \
+            int sum = 0;                                        \
+            for (j = 0; j < 4; j++)                             \
+                sum += transform[4 * i][j] * o_8[j];            \
+            assign(dst[i * dstep], sum);                        \
+        }                                                       \
+    } while (0)
+
+#define FTR_16(dst, src, dstep, sstep, assign)                  \
+    do                                                          \
+    {                                                           \
+        int i, j;                                               \
+        int e_16[8];                                            \
+        int o_16[8];                                            \
+        for (i = 0; i < 8; i++)                                 \
+        {                                                       \
+            e_16[i] = src[i * sstep] + src[(15 - i) * sstep];   \
+            o_16[i] = src[i * sstep] - src[(15 - i) * sstep];   \
+        }                                                       \
+        FTR_8(dst, e_16, 2 * dstep, 1, assign);                 \
+                                                                \
+        for (i = 1; i < 16; i += 2)                             \
+        {                                                       \
+            int sum = 0;                                        \
+            for (j = 0; j < 8; j++)                             \
+                sum += transform[2 * i][j] * o_16[j];           \
+            assign(dst[i * dstep], sum);                        \
+        }                                                       \
+    } while (0)
+
+#define FTR_32(dst, src, dstep, sstep, assign)                  \
+    do                                                          \
+    {                                                           \
+        int i, j;                                               \
+        int e_32[16];                                           \
+        int o_32[16];                                           \
+        for (i = 0; i < 16; i++)                                \
+        {                                                       \
+            e_32[i] = src[i * sstep] + src[(31 - i) * sstep];   \
+            o_32[i] = src[i * sstep] - src[(31 - i) * sstep];   \
+        }                                                       \
+        FTR_16(dst, e_32, 2 * dstep, 1, assign);                \
+                                                                \
+        for (i = 1; i < 32; i += 2)                             \
+        {                                                       \
+            int sum = 0;                                        \
+            for (j = 0; j < 16; j++)                            \
+                sum += transform[i][j] * o_32[j];               \
+            assign(dst[i * dstep], sum);                        \
+        }                                                       \
+    } while (0)
+
+#ifdef VECTOR_FDCT
+#ifndef UHD_TRANSPOSE_BLOCK
+#define UHD_TRANSPOSE_BLOCK
+static uhd_always_inline void uhd_transpose_block(int16_t *dst, const int16_t *src, int size)
+{
+    int x, y;
+
+    for (y = 0; y < size; y++)
     {
-        if (borders[1])
-        {
-            clip_func(_dst, _src, width, sao_offset_val[0]);
-        }
-        if (borders[3])
+        for (x = 0; x < size; x++)
         {
-            int y_stride_dst = (int)stride_dst * (height - 1);
-            int y_stride_src = (int)stride_src * (height - 1);
-
-            clip_func((uint8_t *)(dst + y_stride_dst), (uint8_t *)(src + y_stride_src), width, sao_offset_val[0]);
-            height--;
+            dst[x * size + y] = src[y * size + x];
         }
     }
-    if (sao_eo_class != SAO_EO_VERT)
+}
+#endif
+
+// One forward pass down the columns of src, four columns per int32x4:
+// dst[u * size + c] = (sum_k transform[u * 32 / size][k] * src[k * size + c]
+// + add) >> shift, through the same even/odd split as FTR_4 .. FTR_32.
+static void FUNC(fdct_cols)(int16_t *dst, const int16_t *src, int log2_size, int shift)
+{
+    int size = 1 << log2_size;
+    int half = size / 2;
+    int32x4_t add = vdupq_n_s32(1 << (shift - 1));
+    int32x4_t sh = vdupq_n_s32(-shift);
+    int32x4_t e[16], o[16];
+    int c, k, u;
+
+    for (c = 0; c < size; c += 4)
     {
-        if (borders[0])
+        for (k = 0; k < half; k++)
         {
-            int offset_val = sao_offset_val[0];
-            for (y = 0; y < height; y++)
-            {
-                dst[y * stride_dst] = uhd_clip_pixel(src[y * stride_src] + offset_val);
-            }
+            int32x4_t a = vmovl_s16(vld1_s16(src + k * size + c));
+            int32x4_t b = vmovl_s16(vld1_s16(src + (size - 1 - k) * size + c));
+
+            e[k] = vaddq_s32(a, b);
+            o[k] = vsubq_s32(a, b);
         }
-        if (borders[2])
+        for (u = 0; u < size; u++)
         {
-            int offset_val = sao_offset_val[0];
-            int offset = width - 1;
-            for (x = 0; x < height; x++)
+            const int32x4_t *in = u & 1 ? o : e;
+            const int8_t *coef = transform[u << (5 - log2_size)];
+            int32x4_t acc = add;
+
+            for (k = 0; k < half; k++)
             {
-                dst[x * stride_dst + offset] = uhd_clip_pixel(src[x * stride_src + offset] + offset_val);
+                acc = vmlaq_n_s32(acc, in[k], coef[k]);
             }
-            width--;
+            vst1_s16(dst + u * size + c, vqmovn_s32(vshlq_s32(acc, sh)));
         }
     }
 }
 
-static void FUNC(sao_edge_restore_1)(uint8_t *_dst, uint8_t *_src,
-                                     ptrdiff_t stride_dst, ptrdiff_t stride_src, SAOParams *sao,
-                                     int *borders, int _width, int _height,
-                                     int c_idx, uint8_t *vert_edge,
-                                     uint8_t *horiz_edge, uint8_t *diag_edge, func_clip_row_ptr clip_func)
+// The row pass is a column pass over the transposed residual, and its
+// output is transposed back for the column pass.
+static void FUNC(fdct_vec)(int16_t *coeffs, int log2_size)
 {
-    int x, y;
-    pixel *dst = (pixel *)_dst;
-    pixel *src = (pixel *)_src;
-    int16_t *sao_offset_val = sao->offset_val[c_idx];
-    int sao_eo_class = sao->eo_class[c_idx];
-    int init_x = 0, init_y = 0, width = _width, height = _height;
+    int16_t tmp[32 * 32];
+    int16_t tr[32 * 32];
+    int size = 1 << log2_size;
 
-    stride_dst /= sizeof(pixel);
-    stride_src /= sizeof(pixel);
+    uhd_transpose_block(tr, coeffs, size);
+    FUNC(fdct_cols)(tmp, tr, log2_size, log2_size + BIT_DEPTH - 9);
+    uhd_transpose_block(tr, tmp, size);
+    FUNC(fdct_cols)(coeffs, tr, log2_size, log2_size + 6);
+}
+#endif
 
-    if (sao_eo_class != SAO_EO_HORIZ)
+#ifndef UHD_DST_MATRIX
+#define UHD_DST_MATRIX
+// the 4x4 luma DST, the matrix TR_4x4_LUMA applies transposed
+static const int8_t uhd_dst_matrix[4][4] = {
+    {29, 55, 74, 84},
+    {74, 74, 0, -74},
+    {84, -29, -74, 55},
+    {55, -84, 74, -29},
+};
+#endif
+
+// residual in, coefficients out, in place. The _c versions are the scalar
+// references, built with either toggle so the auto-tuner can time them.
+static void FUNC(fdst_4x4_c)(int16_t *coeffs)
+{
+    int shift = BIT_DEPTH - 7;
+    int add = 1 << (shift - 1);
+    int i;
+    int16_t *src = coeffs;
+
+    for (i = 0; i < 4; i++)
     {
-        if (borders[1])
-        {
-            clip_func(_dst, _src, width, sao_offset_val[0]);
-            init_y = 1;
-        }
-        if (borders[3])
-        {
-            int y_stride_dst = (int)stride_dst * (height - 1);
-            int y_stride_src = (int)stride_src * (height - 1);
-            clip_func((uint8_t *)(dst + y_stride_dst), (uint8_t *)(src + y_stride_src), width, sao_offset_val[0]);
-            height--;
-        }
+        FTR_4x4_LUMA(src, src, 1, SCALE);
+        src += 4;
     }
 
-    if (sao_eo_class != SAO_EO_VERT)
+    shift = 8;
+    add = 1 << (shift - 1);
+    for (i = 0; i < 4; i++)
     {
-        if (borders[0])
+        FTR_4x4_LUMA(coeffs, coeffs, 4, SCALE);
+        coeffs++;
+    }
+}
+
+static void FUNC(fdst_4x4)(int16_t *coeffs)
+{
+#ifdef SCALAR_FDCT
+    FUNC(fdst_4x4_c)(coeffs);
+#endif
+
+#ifdef VECTOR_FDCT
+    int shift = BIT_DEPTH - 7;
+    int add = 1 << (shift - 1);
+
+    // rows then columns as a pair of 4x4 matrix products, one row per int32x4
+    int16_t tr[16];
+    int16_t tmp[16];
+    int pass, k, u;
+
+    uhd_transpose_block(tr, coeffs, 4);
+    for (pass = 0; pass < 2; pass++)
+    {
+        int16_t *out = pass ? coeffs : tmp;
+        int32x4_t sh = vdupq_n_s32(-shift);
+        int32x4_t in[4];
+
+        for (k = 0; k < 4; k++)
         {
-            int offset_val = sao_offset_val[0];
-            for (y = 0; y < height; y++)
+            in[k] = vmovl_s16(vld1_s16(tr + 4 * k));
+        }
+        for (u = 0; u < 4; u++)
+        {
+            int32x4_t acc = vdupq_n_s32(add);
+
+            for (k = 0; k < 4; k++)
             {
-                dst[y * stride_dst] = uhd_clip_pixel(src[y * stride_src] + offset_val);
+                acc = vmlaq_n_s32(acc, in[k], uhd_dst_matrix[u][k]);
             }
-            init_x = 1;
+            vst1_s16(out + 4 * u, vqmovn_s32(vshlq_s32(acc, sh)));
         }
-        if (borders[2])
+        if (!pass)
         {
-            int offset_val = sao_offset_val[0];
-            int offset = width - 1;
-            for (x = 0; x < height; x++)
+            uhd_transpose_block(tr, tmp, 4);
+        }
+        shift = 8;
+        add = 1 << (shift - 1);
+    }
+#endif
+}
+
+#define FDCT_C(H, log2)                                                \
+    static void FUNC(fdct_##H##x##H##_c)(int16_t * coeffs)             \
+    {                                                                  \
+        int i;                                                         \
+        int shift = log2 + BIT_DEPTH - 9;                              \
+        int add = 1 << (shift - 1);                                    \
+        int16_t *src = coeffs;                                         \
+                                                                       \
+        for (i = 0; i < H; i++)                                        \
+        {                                                              \
+            FTR_##H(src, src, 1, 1, SCALE);                            \
+            src += H;                                                  \
+        }                                                              \
+                                                                       \
+        shift = log2 + 6;                                              \
+        add = 1 << (shift - 1);                                        \
+        for (i = 0; i < H; i++)                                        \
+        {                                                              \
+            FTR_##H(coeffs, coeffs, H, H, SCALE);                      \
+            coeffs++;                                                  \
+        }                                                              \
+    }
+
+FDCT_C(4, 2)
+FDCT_C(8, 3)
+FDCT_C(16, 4)
+FDCT_C(32, 5)
+
+#undef FDCT_C
+
+#ifdef SCALAR_FDCT
+#define FDCT(H, log2)                                     \
+    static void FUNC(fdct_##H##x##H)(int16_t * coeffs)    \
+    {                                                     \
+        FUNC(fdct_##H##x##H##_c)(coeffs);                 \
+    }
+#endif
+
+#ifdef VECTOR_FDCT
+#define FDCT(H, log2)                                     \
+    static void FUNC(fdct_##H##x##H)(int16_t * coeffs)    \
+    {                                                     \
+        FUNC(fdct_vec)(coeffs, log2);                     \
+    }
+#endif
+
+FDCT(4, 2)
+FDCT(8, 3)
+FDCT(16, 4)
+FDCT(32, 5)
+
+#undef FDCT
+#undef FTR_4x4_LUMA
+#undef FTR_4
+#undef FTR_8
+#undef FTR_16
+#undef FTR_32
+
+#undef TR_4
+#undef TR_8
+#undef TR_16
+#undef TR_32
+
+#undef SET
+#undef SCALE
+#undef ADD_AND_SCALE
+
+#ifdef UHD_KERNEL_SELFTEST
+// HM's integer transforms are not lossless even without quantization, as
+// the matrices are only close to orthogonal. So fdct_NxN then idct_NxN (and
+// fdst_4x4 then transform_4x4_luma) is checked against the same round trip
+// in exact arithmetic through the same matrices, which leaves the rounding
+// of the four passes. That is allowed one sample plus two steps of the
+// forward output, 2^(BIT_DEPTH + log2 - 15) samples (2^(BIT_DEPTH - 13) for
+// the DST).
+
+// the round trip of res through the integer matrix m (rows of period
+// m_stride) without rounding: m^T m res m^T m over the squared matrix norms
+static void FUNC(selftest_roundtrip_ref)(double *out, const int16_t *res, const int8_t *m, int m_stride,
+                                         int size, double norm)
+{
+    double a[32 * 32], b[32 * 32];
+    int pass, u, x, k;
+
+    // each pass multiplies the transpose of the previous result by m (the
+    // forward rows, then columns) or by m^T (the inverse ones)
+    for (x = 0; x < size * size; x++)
+    {
+        a[x] = res[x];
+    }
+    for (pass = 0; pass < 4; pass++)
+    {
+        for (u = 0; u < size; u++)
+        {
+            for (x = 0; x < size; x++)
             {
-                dst[x * stride_dst + offset] = uhd_clip_pixel(src[x * stride_src + offset] + offset_val);
+                double sum = 0;
+
+                for (k = 0; k < size; k++)
+                {
+                    sum += (pass < 2 ? m[u * m_stride + k] : m[k * m_stride + u]) * a[x * size + k];
+                }
+                b[u * size + x] = sum;
             }
-            width--;
         }
+        memcpy(a, b, size * size * sizeof(double));
+    }
+    for (x = 0; x < size * size; x++)
+    {
+        out[x] = a[x] / norm;
     }
+}
 
+// Returns the number of samples outside the tolerance over flat and
+// checkerboard blocks at the extremes and 256 pseudo-random full-range
+// blocks per transform.
+static int FUNC(selftest_fdct_roundtrip)(void)
+{
+    int16_t res[32 * 32], coeffs[32 * 32];
+    double ref[32 * 32];
+    int max = (1 << BIT_DEPTH) - 1;
+    uint32_t seed = 1;
+    int kind, n, i;
+    int fails = 0;
+
+    for (kind = 0; kind < 5; kind++) // the DST, then 4x4 to 32x32
     {
-        int save_upper_left = !diag_edge[0] && sao_eo_class == SAO_EO_135D && !borders[0] && !borders[1];
-        int save_upper_right = !diag_edge[1] && sao_eo_class == SAO_EO_45D && !borders[1] && !borders[2];
-        int save_lower_right = !diag_edge[2] && sao_eo_class == SAO_EO_135D && !borders[2] && !borders[3];
-        int save_lower_left = !diag_edge[3] && sao_eo_class == SAO_EO_45D && !borders[0] && !borders[3];
+        int log2 = kind ? kind + 1 : 2;
+        int size = 1 << log2;
+        double norm = kind ? (double)(4096 << log2) * (4096 << log2) : 16384.0 * 16384.0;
+        double step = (double)(1 << BIT_DEPTH) / (kind ? 1 << (15 - log2) : 1 << 13);
 
-        // Restore pixels that can't be modified
-        if (vert_edge[0] && sao_eo_class != SAO_EO_VERT)
+        for (n = 0; n < 4 + 256; n++)
         {
-            for (y = init_y + save_upper_left; y < height - save_lower_left; y++)
+            for (i = 0; i < size * size; i++)
             {
-                dst[y * stride_dst] = src[y * stride_src];
+                int checker = (i / size + i % size) & 1;
+
+                seed = seed * 1664525 + 1013904223;
+                res[i] = n == 0   ? max
+                         : n == 1 ? -max
+                         : n == 2 ? (checker ? max : -max)
+                         : n == 3 ? (checker ? -max : max)
+                                  : (int)(seed >> 8) % (2 * max + 1) - max;
             }
-        }
-        if (vert_edge[1] && sao_eo_class != SAO_EO_VERT)
-        {
-            for (y = init_y + save_upper_right; y < height - save_lower_right; y++)
+            memcpy(coeffs, res, size * size * sizeof(int16_t));
+            switch (kind)
             {
-                dst[y * stride_dst + width - 1] = src[y * stride_src + width - 1];
+            case 0:
+                FUNC(fdst_4x4)(coeffs);
+                FUNC(transform_4x4_luma)(coeffs);
+                break;
+            case 1:
+                FUNC(fdct_4x4)(coeffs);
+                FUNC(idct_4x4)(coeffs, 4);
+                break;
+            case 2:
+                FUNC(fdct_8x8)(coeffs);
+                FUNC(idct_8x8)(coeffs, 8);
+                break;
+            case 3:
+                FUNC(fdct_16x16)(coeffs);
+                FUNC(idct_16x16)(coeffs, 16);
+                break;
+            default:
+                FUNC(fdct_32x32)(coeffs);
+                FUNC(idct_32x32)(coeffs, 32);
+                break;
             }
-        }
+            FUNC(selftest_roundtrip_ref)(ref, res, kind ? transform[0] : uhd_dst_matrix[0],
+                                         kind ? 32 << (5 - log2) : 4, size, norm);
+            for (i = 0; i < size * size; i++)
+            {
+                double err = coeffs[i] - ref[i];
 
-        if (horiz_edge[0] && sao_eo_class != SAO_EO_HORIZ)
-        {
-            memcpy(dst + init_x + save_upper_left, src + init_x + save_upper_left,
-                   (width - save_upper_right - init_x - save_upper_left) * sizeof(pixel));
-        }
-        if (horiz_edge[1] && sao_eo_class != SAO_EO_HORIZ)
-        {
-            memcpy(dst + (height - 1) * stride_dst + init_x + save_lower_left,
-                   src + (height - 1) * stride_src + init_x + save_lower_left,
-                   (width - save_lower_right - init_x - save_lower_left) * sizeof(pixel));
-        }
-        if (diag_edge[0] && sao_eo_class == SAO_EO_135D)
-        {
-            dst[0] = src[0];
-        }
-        if (diag_edge[1] && sao_eo_class == SAO_EO_45D)
-        {
-            dst[width - 1] = src[width - 1];
-        }
-        if (diag_edge[2] && sao_eo_class == SAO_EO_135D)
-        {
-            dst[stride_dst * (height - 1) + width - 1] = src[stride_src * (height - 1) + width - 1];
-        }
-        if (diag_edge[3] && sao_eo_class == SAO_EO_45D)
-        {
-            dst[stride_dst * (height - 1)] = src[stride_src * (height - 1)];
+                fails += err > 1 + 2 * step || err < -1 - 2 * step;
+            }
         }
     }
+    return fails;
 }
+#endif
 
-#undef CMP
-
-////////////////////////////////////////////////////////////////////////////////
-//
-////////////////////////////////////////////////////////////////////////////////
-static void FUNC(put_hevc_pel_pixels)(int16_t *dst,
-                                      uint8_t *_src, ptrdiff_t _srcstride,
-                                      int height, intptr_t mx, intptr_t my, int width)
+static uhd_always_inline void FUNC(sao_band_filter_store)(uint8_t *_dst, uint8_t *_src,
+                                                          ptrdiff_t stride_dst, ptrdiff_t stride_src,
+                                                          int16_t *sao_offset_val, int sao_left_class,
+                                                          int width, int height, int nt)
 {
-    int x, y;
+    pixel *dst = (pixel *)_dst;
     pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    int offset_table[32] = {0};
+    int k, y, x;
+    int shift = BIT_DEPTH - 5;
+
+    stride_dst /= sizeof(pixel);
+    stride_src /= sizeof(pixel);
 
+    for (k = 0; k < 4; k++)
+    {
+        offset_table[(k + sao_left_class) & 31] = sao_offset_val[k + 1];
+    }
     for (y = 0; y < height; y++)
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = src[x] << (14 - BIT_DEPTH);
-        }
-        src += srcstride;
-        dst += MAX_PB_SIZE;
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(src[x] + offset_table[src[x] >> shift]));
+        dst += stride_dst;
+        src += stride_src;
     }
 }
 
-static void FUNC(put_hevc_pel_uni_pixels)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                          int height, intptr_t mx, intptr_t my, int width)
+static void FUNC(sao_band_filter)(uint8_t *_dst, uint8_t *_src,
+                                  ptrdiff_t stride_dst, ptrdiff_t stride_src,
+                                  int16_t *sao_offset_val, int sao_left_class,
+                                  int width, int height)
 {
-    int y;
+    FUNC(sao_band_filter_store)(_dst, _src, stride_dst, stride_src, sao_offset_val, sao_left_class, width, height, 0);
+}
+
+static void FUNC(sao_band_filter_nt)(uint8_t *_dst, uint8_t *_src,
+                                     ptrdiff_t stride_dst, ptrdiff_t stride_src,
+                                     int16_t *sao_offset_val, int sao_left_class,
+                                     int width, int height)
+{
+    FUNC(sao_band_filter_store)(_dst, _src, stride_dst, stride_src, sao_offset_val, sao_left_class, width, height, 1);
+}
+
+#define VECTOR_SAO
+
+#define CMP(a, b) (((a) > (b)) - ((a) < (b)))
+
+static uhd_always_inline void FUNC(sao_edge_filter_store)(uint8_t *_dst, uint8_t *_src, ptrdiff_t stride_dst,
+                                                          int16_t *sao_offset_val, int eo, int width, int height,
+                                                          int nt)
+{
+
+    // padded to the 8 bytes the vector path loads
+    static const uint8_t edge_idx[8] = {1, 2, 0, 3, 4};
+    static const int8_t pos[4][2][2] =
+        {
+            {{-1, 0}, {1, 0}},  // horizontal
+            {{0, -1}, {0, 1}},  // vertical
+            {{-1, -1}, {1, 1}}, // 45 degree
+            {{1, -1}, {-1, 1}}, // 135 degree
+        };
+    pixel *dst = (pixel *)_dst;
+    pixel *src = (pixel *)_src;
+    int a_stride, b_stride;
+    int x, y;
+    ptrdiff_t stride_src = (2 * MAX_PB_SIZE + UHD_INPUT_BUFFER_PADDING_SIZE) / sizeof(pixel);
+    stride_dst /= sizeof(pixel);
+
+    a_stride = pos[eo][0][0] + pos[eo][0][1] * (int)stride_src;
+    b_stride = pos[eo][1][0] + pos[eo][1][1] * (int)stride_src;
+
+#ifdef SCALAR_SAO
+    for (y = 0; y < height; y++)
+    {
+        UHD_PUT_ROW(dst, width, nt, x,
+                    uhd_clip_pixel(src[x] + sao_offset_val[edge_idx[2 + CMP(src[x], src[x + a_stride]) +
+                                                                    CMP(src[x], src[x + b_stride])]]));
+        src += stride_src;
+        dst += stride_dst;
+    }
+#endif
+
+#ifdef VECTOR_SAO
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x += 8)
+        {
+            uint16x8_t src0 = FUNC(load_pixels8)(src + x);
+            uint16x8_t src1 = FUNC(load_pixels8)(src + x + a_stride);
+            uint16x8_t src2 = FUNC(load_pixels8)(src + x + b_stride);
+
+            // computes a>b - a<b to calculate diff0 and diff1
+            uint16x8_t gt0 = vcgtq_u16(src0, src1);
+            uint16x8_t lt0 = vcltq_u16(src0, src1);
+            uint16x8_t gt1 = vcgtq_u16(src0, src2);
+            uint16x8_t lt1 = vcltq_u16(src0, src2);
+
+            int8x8_t diff0 = vmovn_s16(vreinterpretq_s16_u16(vsubq_u16(lt0, gt0)));
+            int8x8_t diff1 = vmovn_s16(vreinterpretq_s16_u16(vsubq_u16(lt1, gt1)));
+
+            // calculating offset value
+            int8x8_t edge_index = vreinterpret_s8_u8(vld1_u8(edge_idx));
+            int8x8_t ed_pos = vadd_s8(vadd_s8(vdup_n_s8(2), diff0), diff1);
+            int8x8_t off_val = vtbl1_s8(edge_index, ed_pos);
+
+            // calculates sao offset value
+            int16x8_t sao = vld1q_s16(sao_offset_val);
+            int8x8_t s_o = vqmovn_s16(sao);
+            int16x8_t offset = vmovl_s8(vtbl1_s8(s_o, off_val));
+
+            // adding src and sao offset value
+            int32x4_t f_add0 = vuqaddq_s32(vmovl_s16(vget_low_s16(offset)), vmovl_u16(vget_low_u16(src0)));
+            int32x4_t f_add1 = vuqaddq_s32(vmovl_s16(vget_high_s16(offset)), vmovl_u16(vget_high_u16(src0)));
+
+            // clipping operation
+            uint16x4_t clip0 = vqmovun_s32(f_add0);
+            uint16x4_t clip1 = vqmovun_s32(f_add1);
+            uint16x8_t clip = vminq_u16(vcombine_u16(clip0, clip1), vdupq_n_u16((1 << BIT_DEPTH) - 1));
+
+            FUNC(store_pixels8_hint)(dst + x, clip, nt);
+        }
+        src += stride_src;
+        dst += stride_dst;
+    }
+#endif
+}
+
+static void FUNC(sao_edge_filter)(uint8_t *_dst, uint8_t *_src, ptrdiff_t stride_dst, int16_t *sao_offset_val,
+                                  int eo, int width, int height)
+{
+    FUNC(sao_edge_filter_store)(_dst, _src, stride_dst, sao_offset_val, eo, width, height, 0);
+}
+
+static void FUNC(sao_edge_filter_nt)(uint8_t *_dst, uint8_t *_src, ptrdiff_t stride_dst, int16_t *sao_offset_val,
+                                     int eo, int width, int height)
+{
+    FUNC(sao_edge_filter_store)(_dst, _src, stride_dst, sao_offset_val, eo, width, height, 1);
+}
+
+// SAO statistics for the encoder. For each edge class and category
+// (indexed like sao_offset_val) and for each of the 32 bands, the sum of
+// original minus reconstructed samples and their count. The categories and
+// bands are worked out on the deblocked reconstruction exactly as in
+// sao_edge_filter and sao_band_filter.
+#ifndef UHD_SAO_STATS
+#define UHD_SAO_STATS
+typedef struct UHDSaoStats
+{
+    int64_t eo_diff[4][5];
+    int32_t eo_count[4][5];
+    int64_t bo_diff[32];
+    int32_t bo_count[32];
+} UHDSaoStats;
+#endif
+
+#define VECTOR_SAO_STATS
+
+// Adds the statistics of one CTB component (at most 64x64) to stats in a
+// single pass over org and rec. Each sample of the region needs its eight
+// rec neighbours, so at picture borders the caller trims the region.
+static void FUNC(sao_stats)(UHDSaoStats *stats, const uint8_t *_org, ptrdiff_t stride_org,
+                            const uint8_t *_rec, ptrdiff_t stride_rec, int width, int height)
+{
+    static const uint8_t edge_idx[5] = {1, 2, 0, 3, 4};
+    static const int8_t pos[4][2][2] =
+        {
+            {{-1, 0}, {1, 0}},  // horizontal
+            {{0, -1}, {0, 1}},  // vertical
+            {{-1, -1}, {1, 1}}, // 45 degree
+            {{1, -1}, {-1, 1}}, // 135 degree
+        };
+    const pixel *org = (const pixel *)_org;
+    const pixel *rec = (const pixel *)_rec;
+    int a_stride[4], b_stride[4];
+    int shift = BIT_DEPTH - 5;
+    int c, k, x, y;
+#ifdef VECTOR_SAO_STATS
+    // CMP(a) + CMP(b) for each category: edge_idx[2 + sum] == k
+    static const int8_t cat_sum[5] = {0, -2, -1, 1, 2};
+    int32x4_t eo_diff[4][5];
+    uint16x8_t eo_count[4][5];
+    int16_t diff_lane[8];
+    uint16_t band_lane[8];
+
+    for (c = 0; c < 4; c++)
+    {
+        for (k = 0; k < 5; k++)
+        {
+            eo_diff[c][k] = vdupq_n_s32(0);
+            eo_count[c][k] = vdupq_n_u16(0);
+        }
+    }
+#endif
+
+    stride_org /= sizeof(pixel);
+    stride_rec /= sizeof(pixel);
+    for (c = 0; c < 4; c++)
+    {
+        a_stride[c] = pos[c][0][0] + pos[c][0][1] * (int)stride_rec;
+        b_stride[c] = pos[c][1][0] + pos[c][1][1] * (int)stride_rec;
+    }
+
+    for (y = 0; y < height; y++)
+    {
+        x = 0;
+#ifdef VECTOR_SAO_STATS
+        for (; x + 8 <= width; x += 8)
+        {
+            uint16x8_t r = FUNC(load_pixels8)(rec + x);
+            int16x8_t d = vsubq_s16(FUNC(pel_load8)(org + x), vreinterpretq_s16_u16(r));
+
+            vst1q_s16(diff_lane, d);
+            vst1q_u16(band_lane, vshrq_n_u16(r, BIT_DEPTH - 5));
+            for (k = 0; k < 8; k++)
+            {
+                stats->bo_diff[band_lane[k]] += diff_lane[k];
+                stats->bo_count[band_lane[k]]++;
+            }
+
+            for (c = 0; c < 4; c++)
+            {
+                uint16x8_t ra = FUNC(load_pixels8)(rec + x + a_stride[c]);
+                uint16x8_t rb = FUNC(load_pixels8)(rec + x + b_stride[c]);
+                int16x8_t sum = vaddq_s16(vreinterpretq_s16_u16(vsubq_u16(vcltq_u16(r, ra), vcgtq_u16(r, ra))),
+                                          vreinterpretq_s16_u16(vsubq_u16(vcltq_u16(r, rb), vcgtq_u16(r, rb))));
+
+                for (k = 0; k < 5; k++)
+                {
+                    uint16x8_t in = vceqq_s16(sum, vdupq_n_s16(cat_sum[k]));
+
+                    eo_diff[c][k] = vpadalq_s16(eo_diff[c][k], vandq_s16(d, vreinterpretq_s16_u16(in)));
+                    eo_count[c][k] = vsubq_u16(eo_count[c][k], in);
+                }
+            }
+        }
+#endif
+        for (; x < width; x++)
+        {
+            int diff = org[x] - rec[x];
+
+            stats->bo_diff[rec[x] >> shift] += diff;
+            stats->bo_count[rec[x] >> shift]++;
+            for (c = 0; c < 4; c++)
+            {
+                int cat = edge_idx[2 + CMP(rec[x], rec[x + a_stride[c]]) + CMP(rec[x], rec[x + b_stride[c]])];
+
+                stats->eo_diff[c][cat] += diff;
+                stats->eo_count[c][cat]++;
+            }
+        }
+        org += stride_org;
+        rec += stride_rec;
+    }
+
+#ifdef VECTOR_SAO_STATS
+    for (c = 0; c < 4; c++)
+    {
+        for (k = 0; k < 5; k++)
+        {
+            stats->eo_diff[c][k] += vaddvq_s32(eo_diff[c][k]);
+            stats->eo_count[c][k] += vaddlvq_u16(eo_count[c][k]);
+        }
+    }
+#endif
+}
+
+static void FUNC(clip_row)(uint8_t *_dst, uint8_t *_src, int width, int offset_val)
+{
+    pixel *dst = (pixel *)_dst;
+    pixel *src = (pixel *)_src;
+
+    for (int x = 0; x < width; x++)
+    {
+        dst[x] = uhd_clip_pixel(src[x] + offset_val);
+    }
+}
+
+static void FUNC(sao_edge_restore_0)(uint8_t *_dst, uint8_t *_src,
+                                     ptrdiff_t stride_dst, ptrdiff_t stride_src, SAOParams *sao,
+                                     int *borders, int _width, int _height,
+                                     int c_idx, uint8_t *vert_edge,
+                                     uint8_t *horiz_edge, uint8_t *diag_edge, func_clip_row_ptr clip_func)
+{
+    int x, y;
+    pixel *dst = (pixel *)_dst;
+    pixel *src = (pixel *)_src;
+    int16_t *sao_offset_val = sao->offset_val[c_idx];
+    int sao_eo_class = sao->eo_class[c_idx];
+    int width = _width, height = _height;
+
+    stride_dst /= sizeof(pixel);
+    stride_src /= sizeof(pixel);
+
+    if (sao_eo_class != SAO_EO_HORIZ)
+    {
+        if (borders[1])
+        {
+            clip_func(_dst, _src, width, sao_offset_val[0]);
+        }
+        if (borders[3])
+        {
+            int y_stride_dst = (int)stride_dst * (height - 1);
+            int y_stride_src = (int)stride_src * (height - 1);
+
+            clip_func((uint8_t *)(dst + y_stride_dst), (uint8_t *)(src + y_stride_src), width, sao_offset_val[0]);
+            height--;
+        }
+    }
+    if (sao_eo_class != SAO_EO_VERT)
+    {
+        if (borders[0])
+        {
+            int offset_val = sao_offset_val[0];
+            for (y = 0; y < height; y++)
+            {
+                dst[y * stride_dst] = uhd_clip_pixel(src[y * stride_src] + offset_val);
+            }
+        }
+        if (borders[2])
+        {
+            int offset_val = sao_offset_val[0];
+            int offset = width - 1;
+            for (x = 0; x < height; x++)
+            {
+                dst[x * stride_dst + offset] = uhd_clip_pixel(src[x * stride_src + offset] + offset_val);
+            }
+            width--;
+        }
+    }
+}
+
+static void FUNC(sao_edge_restore_1)(uint8_t *_dst, uint8_t *_src,
+                                     ptrdiff_t stride_dst, ptrdiff_t stride_src, SAOParams *sao,
+                                     int *borders, int _width, int _height,
+                                     int c_idx, uint8_t *vert_edge,
+                                     uint8_t *horiz_edge, uint8_t *diag_edge, func_clip_row_ptr clip_func)
+{
+    int x, y;
+    pixel *dst = (pixel *)_dst;
+    pixel *src = (pixel *)_src;
+    int16_t *sao_offset_val = sao->offset_val[c_idx];
+    int sao_eo_class = sao->eo_class[c_idx];
+    int init_x = 0, init_y = 0, width = _width, height = _height;
+
+    stride_dst /= sizeof(pixel);
+    stride_src /= sizeof(pixel);
+
+    if (sao_eo_class != SAO_EO_HORIZ)
+    {
+        if (borders[1])
+        {
+            clip_func(_dst, _src, width, sao_offset_val[0]);
+            init_y = 1;
+        }
+        if (borders[3])
+        {
+            int y_stride_dst = (int)stride_dst * (height - 1);
+            int y_stride_src = (int)stride_src * (height - 1);
+            clip_func((uint8_t *)(dst + y_stride_dst), (uint8_t *)(src + y_stride_src), width, sao_offset_val[0]);
+            height--;
+        }
+    }
+
+    if (sao_eo_class != SAO_EO_VERT)
+    {
+        if (borders[0])
+        {
+            int offset_val = sao_offset_val[0];
+            for (y = 0; y < height; y++)
+            {
+                dst[y * stride_dst] = uhd_clip_pixel(src[y * stride_src] + offset_val);
+            }
+            init_x = 1;
+        }
+        if (borders[2])
+        {
+            int offset_val = sao_offset_val[0];
+            int offset = width - 1;
+            for (x = 0; x < height; x++)
+            {
+                dst[x * stride_dst + offset] = uhd_clip_pixel(src[x * stride_src + offset] + offset_val);
+            }
+            width--;
+        }
+    }
+
+    {
+        int save_upper_left = !diag_edge[0] && sao_eo_class == SAO_EO_135D && !borders[0] && !borders[1];
+        int save_upper_right = !diag_edge[1] && sao_eo_class == SAO_EO_45D && !borders[1] && !borders[2];
+        int save_lower_right = !diag_edge[2] && sao_eo_class == SAO_EO_135D && !borders[2] && !borders[3];
+        int save_lower_left = !diag_edge[3] && sao_eo_class == SAO_EO_45D && !borders[0] && !borders[3];
+
+        // Restore pixels that can't be modified
+        if (vert_edge[0] && sao_eo_class != SAO_EO_VERT)
+        {
+            for (y = init_y + save_upper_left; y < height - save_lower_left; y++)
+            {
+                dst[y * stride_dst] = src[y * stride_src];
+            }
+        }
+        if (vert_edge[1] && sao_eo_class != SAO_EO_VERT)
+        {
+            for (y = init_y + save_upper_right; y < height - save_lower_right; y++)
+            {
+                dst[y * stride_dst + width - 1] = src[y * stride_src + width - 1];
+            }
+        }
+
+        if (horiz_edge[0] && sao_eo_class != SAO_EO_HORIZ)
+        {
+            memcpy(dst + init_x + save_upper_left, src + init_x + save_upper_left,
+                   (width - save_upper_right - init_x - save_upper_left) * sizeof(pixel));
+        }
+        if (horiz_edge[1] && sao_eo_class != SAO_EO_HORIZ)
+        {
+            memcpy(dst + (height - 1) * stride_dst + init_x + save_lower_left,
+                   src + (height - 1) * stride_src + init_x + save_lower_left,
+                   (width - save_lower_right - init_x - save_lower_left) * sizeof(pixel));
+        }
+        if (diag_edge[0] && sao_eo_class == SAO_EO_135D)
+        {
+            dst[0] = src[0];
+        }
+        if (diag_edge[1] && sao_eo_class == SAO_EO_45D)
+        {
+            dst[width - 1] = src[width - 1];
+        }
+        if (diag_edge[2] && sao_eo_class == SAO_EO_135D)
+        {
+            dst[stride_dst * (height - 1) + width - 1] = src[stride_src * (height - 1) + width - 1];
+        }
+        if (diag_edge[3] && sao_eo_class == SAO_EO_45D)
+        {
+            dst[stride_dst * (height - 1)] = src[stride_src * (height - 1)];
+        }
+    }
+}
+
+#undef CMP
+
+////////////////////////////////////////////////////////////////////////////////
+// Streaming-store variants (name_nt) for the last write to a picture that is
+// not used as a reference, e.g. one handed straight to display or an encoder.
+// Each kernel below that writes pixels is an inline name_store body with an
+// nt flag on its store hook (store_pixels8_hint, pel_store8_hint, UHD_PUT_ROW);
+// PUT_NT_* instantiates it as name with plain stores and as name_nt with STNP.
+////////////////////////////////////////////////////////////////////////////////
+#define PUT_NT_UNI(name)                                                                                   \
+    static void FUNC(name)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,       \
+                           int height, intptr_t mx, intptr_t my, int width)                                \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, height, mx, my, width, 0);                  \
+    }                                                                                                      \
+    static void FUNC(name##_nt)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,  \
+                                int height, intptr_t mx, intptr_t my, int width)                           \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, height, mx, my, width, 1);                  \
+    }
+
+#define PUT_NT_BI(name)                                                                                    \
+    static void FUNC(name)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,       \
+                           int16_t *src2, int height, intptr_t mx, intptr_t my, int width)                 \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, src2, height, mx, my, width, 0);            \
+    }                                                                                                      \
+    static void FUNC(name##_nt)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,  \
+                                int16_t *src2, int height, intptr_t mx, intptr_t my, int width)            \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, src2, height, mx, my, width, 1);            \
+    }
+
+#define PUT_NT_UNI_W(name)                                                                                 \
+    static void FUNC(name)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,       \
+                           int height, int denom, int wx, int ox,                                          \
+                           intptr_t mx, intptr_t my, int width)                                            \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, height, denom, wx, ox, mx, my, width, 0);   \
+    }                                                                                                      \
+    static void FUNC(name##_nt)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,  \
+                                int height, int denom, int wx, int ox,                                     \
+                                intptr_t mx, intptr_t my, int width)                                       \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, height, denom, wx, ox, mx, my, width, 1);   \
+    }
+
+#define PUT_NT_BI_W(name)                                                                                  \
+    static void FUNC(name)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,       \
+                           int16_t *src2, int height, int denom, int wx0, int wx1,                         \
+                           int ox0, int ox1, intptr_t mx, intptr_t my, int width)                          \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, src2, height, denom, wx0, wx1,              \
+                           ox0, ox1, mx, my, width, 0);                                                    \
+    }                                                                                                      \
+    static void FUNC(name##_nt)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,  \
+                                int16_t *src2, int height, int denom, int wx0, int wx1,                    \
+                                int ox0, int ox1, intptr_t mx, intptr_t my, int width)                     \
+    {                                                                                                      \
+        FUNC(name##_store)(_dst, _dststride, _src, _srcstride, src2, height, denom, wx0, wx1,              \
+                           ox0, ox1, mx, my, width, 1);                                                    \
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////
+// The pel_* kernels run eight lanes per step and finish odd chroma widths
+// (2, 4, 6, 12) with the scalar expression.
+static void FUNC(put_hevc_pel_pixels)(int16_t *dst,
+                                      uint8_t *_src, ptrdiff_t _srcstride,
+                                      int height, intptr_t mx, intptr_t my, int width)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            vst1q_s16(dst + x, vshlq_n_s16(FUNC(pel_load8)(src + x), 14 - BIT_DEPTH));
+        }
+        for (; x < width; x++)
+        {
+            dst[x] = src[x] << (14 - BIT_DEPTH);
+        }
+        src += srcstride;
+        dst += MAX_PB_SIZE;
+    }
+}
+
+static void FUNC(put_hevc_pel_uni_pixels)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
+                                          int height, intptr_t mx, intptr_t my, int width)
+{
+    int y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+
+    for (y = 0; y < height; y++)
+    {
+        memcpy(dst, src, width * sizeof(pixel));
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+#ifndef UHD_PEL_ALIAS
+#define UHD_PEL_ALIAS
+// stores 32 bytes with a non-temporal hint, so write-once output does not evict
+// reference samples from the cache
+static uhd_always_inline void uhd_store_nt_32(uint8_t *dst, uint8x16_t a, uint8x16_t b)
+{
+#if defined(__aarch64__)
+    __asm__ volatile("stnp %q1, %q2, [%0]" : : "r"(dst), "w"(a), "w"(b) : "memory");
+#else
+    vst1q_u8(dst, a);
+    vst1q_u8(dst + 16, b);
+#endif
+}
+
+static inline void uhd_copy_rows_nt(uint8_t *dst, ptrdiff_t dststride, const uint8_t *src, ptrdiff_t srcstride,
+                                    int row_size, int height)
+{
+    int x, y;
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x + 32 <= row_size; x += 32)
+        {
+            uhd_store_nt_32(dst + x, vld1q_u8(src + x), vld1q_u8(src + x + 16));
+        }
+        memcpy(dst + x, src + x, row_size - x);
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+// A skip CU with an integer MV and no residual predicts an unmodified block of
+// the reference picture. Instead of copying it right away the reconstruction
+// can record the block here and copy every pending block in one streaming pass
+// with uhd_pel_alias_flush. The list must be flushed before anything reads the
+// aliased samples of the picture: intra prediction of a neighbouring CU,
+// deblocking and SAO, output, and use of the picture as a reference. A reader
+// may instead go through uhd_pel_alias_resolve, which maps a block of the
+// picture to the reference samples it stands for. A picture that is never
+// output, has no in-loop filters to run, and whose every read goes through
+// uhd_pel_alias_resolve needs no copy at all; only then may uhd_pel_alias_reset
+// drop the list.
+typedef struct UHDPelAlias
+{
+    uint8_t *dst;
+    const uint8_t *src;
+    ptrdiff_t dststride;
+    ptrdiff_t srcstride;
+    int row_size;   // in bytes
+    int height;
+} UHDPelAlias;
+
+typedef struct UHDPelAliasList
+{
+    UHDPelAlias *alias; // caller-owned storage for max_alias entries
+    int nb_alias;
+    int max_alias;
+} UHDPelAliasList;
+
+static inline void uhd_pel_alias_reset(UHDPelAliasList *list)
+{
+    list->nb_alias = 0;
+}
+
+// Looks up the row_size x height byte block at pos in the picture. Returns 1
+// with *src and *srcstride set when one pending alias covers it, 0 when none
+// overlaps it (the picture samples are current), or -1 when it straddles
+// aliases or the edge of one; the caller then flushes and reads the picture.
+// Later aliases win, as they would once flushed.
+static int uhd_pel_alias_resolve(const UHDPelAliasList *list, const uint8_t *pos, int row_size, int height,
+                                 const uint8_t **src, ptrdiff_t *srcstride)
+{
+    int i;
+
+    for (i = list->nb_alias - 1; i >= 0; i--)
+    {
+        const UHDPelAlias *a = &list->alias[i];
+        // rows of the block and the alias share the picture stride
+        ptrdiff_t off = (ptrdiff_t)((uintptr_t)pos - (uintptr_t)a->dst);
+        ptrdiff_t last = off + (height - 1) * a->dststride + row_size - 1;
+        ptrdiff_t row, col, last_row, last_col;
+
+        if (last < 0 || off >= a->height * a->dststride)
+        {
+            continue;
+        }
+        // column in [a->row_size - stride, a->row_size): a block left
+        // of the alias sits at the end of the row above
+        row = off / a->dststride;
+        col = off % a->dststride;
+        if (col < 0)
+        {
+            col += a->dststride;
+            row--;
+        }
+        if (col >= a->row_size)
+        {
+            col -= a->dststride;
+            row++;
+        }
+        last_row = row + height - 1;
+        last_col = col + row_size - 1;
+        if (last_row < 0 || row >= a->height || last_col < 0 || col >= a->row_size)
+        {
+            continue;
+        }
+        if (row < 0 || col < 0 || last_row >= a->height || last_col >= a->row_size)
+        {
+            return -1;
+        }
+        *src = a->src + row * a->srcstride + col;
+        *srcstride = a->srcstride;
+        return 1;
+    }
+    return 0;
+}
+
+static void uhd_pel_alias_flush(UHDPelAliasList *list)
+{
+    int i;
+
+    for (i = 0; i < list->nb_alias; i++)
+    {
+        const UHDPelAlias *a = &list->alias[i];
+
+        uhd_copy_rows_nt(a->dst, a->dststride, a->src, a->srcstride, a->row_size, a->height);
+    }
+    list->nb_alias = 0;
+}
+#endif
+
+// the _nt copy streams the rows straight from the reference
+static void FUNC(put_hevc_pel_uni_pixels_nt)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                             ptrdiff_t _srcstride, int height, intptr_t mx, intptr_t my, int width)
+{
+    uhd_copy_rows_nt(_dst, _dststride, _src, _srcstride, width * sizeof(pixel), height);
+}
+
+// Records the put_hevc_pel_uni_pixels copy for a later uhd_pel_alias_flush; a
+// full list is flushed first so copies still land in recording order. A list
+// without storage copies right away.
+static void FUNC(put_hevc_pel_uni_alias)(UHDPelAliasList *list,
+                                         uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
+                                         int height, int width)
+{
+    UHDPelAlias *a;
+
+    if (list->max_alias <= 0)
+    {
+        uhd_copy_rows_nt(_dst, _dststride, _src, _srcstride, width * sizeof(pixel), height);
+        return;
+    }
+    if (list->nb_alias >= list->max_alias)
+    {
+        uhd_pel_alias_flush(list);
+    }
+
+    a = &list->alias[list->nb_alias++];
+    a->dst = _dst;
+    a->src = _src;
+    a->dststride = _dststride;
+    a->srcstride = _srcstride;
+    a->row_size = width * sizeof(pixel);
+    a->height = height;
+}
+
+static uhd_always_inline void FUNC(put_hevc_pel_bi_pixels_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                 ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                                 intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+
+    int shift = 14 + 1 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        // a saturated sum still clips to the same pixel, and vrshrq adds the
+        // rounding offset without overflowing
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            int16x8_t sum = vqaddq_s16(vshlq_n_s16(FUNC(pel_load8)(src + x), 14 - BIT_DEPTH),
+                                       vld1q_s16(src2 + x));
+
+            FUNC(pel_store8_hint)(dst + x, vrshrq_n_s16(sum, 14 + 1 - BIT_DEPTH), nt);
+        }
+        for (; x < width; x++)
+        {
+            dst[x] = uhd_clip_pixel(((src[x] << (14 - BIT_DEPTH)) + src2[x] + offset) >> shift);
+        }
+        src += srcstride;
+        dst += dststride;
+        src2 += MAX_PB_SIZE;
+    }
+}
+
+PUT_NT_BI(put_hevc_pel_bi_pixels)
+
+static uhd_always_inline void FUNC(put_hevc_pel_uni_w_pixels_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                    ptrdiff_t _srcstride, int height, int denom, int wx,
+                                                                    int ox, intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    int shift = denom + 14 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    ox = ox * (1 << (BIT_DEPTH - 8));
+    int32x4_t offvector = vdupq_n_s32(offset);
+    int32x4_t shiftvector = vdupq_n_s32(-shift);
+    int32x4_t oxvector = vdupq_n_s32(ox);
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            int16x8_t s = vshlq_n_s16(FUNC(pel_load8)(src + x), 14 - BIT_DEPTH);
+            int32x4_t lo = vmlal_n_s16(offvector, vget_low_s16(s), wx);
+            int32x4_t hi = vmlal_n_s16(offvector, vget_high_s16(s), wx);
+
+            lo = vaddq_s32(vshlq_s32(lo, shiftvector), oxvector);
+            hi = vaddq_s32(vshlq_s32(hi, shiftvector), oxvector);
+            FUNC(pel_store8_hint)(dst + x, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)), nt);
+        }
+        for (; x < width; x++)
+        {
+            dst[x] = uhd_clip_pixel((((src[x] << (14 - BIT_DEPTH)) * wx + offset) >> shift) + ox);
+        }
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+PUT_NT_UNI_W(put_hevc_pel_uni_w_pixels)
+
+static uhd_always_inline void FUNC(put_hevc_pel_bi_w_pixels_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                   ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                                   int denom, int wx0, int wx1, int ox0, int ox1,
+                                                                   intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+
+    int shift = 14 + 1 - BIT_DEPTH;
+    int log2Wd = denom + shift - 1;
+
+    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
+    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
+    int32x4_t offvector = vdupq_n_s32((ox0 + ox1 + 1) << log2Wd);
+    int32x4_t shiftvector = vdupq_n_s32(-(log2Wd + 1));
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            int16x8_t s = vshlq_n_s16(FUNC(pel_load8)(src + x), 14 - BIT_DEPTH);
+            int16x8_t s2 = vld1q_s16(src2 + x);
+            int32x4_t lo = vmlal_n_s16(offvector, vget_low_s16(s), wx1);
+            int32x4_t hi = vmlal_n_s16(offvector, vget_high_s16(s), wx1);
+
+            lo = vshlq_s32(vmlal_n_s16(lo, vget_low_s16(s2), wx0), shiftvector);
+            hi = vshlq_s32(vmlal_n_s16(hi, vget_high_s16(s2), wx0), shiftvector);
+            FUNC(pel_store8_hint)(dst + x, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)), nt);
+        }
+        for (; x < width; x++)
+        {
+            dst[x] = uhd_clip_pixel(((src[x] << (14 - BIT_DEPTH)) * wx1 + src2[x] * wx0 + ((ox0 + ox1 + 1) << log2Wd)) >>
+                                    (log2Wd + 1));
+        }
+        src += srcstride;
+        dst += dststride;
+        src2 += MAX_PB_SIZE;
+    }
+}
+
+PUT_NT_BI_W(put_hevc_pel_bi_w_pixels)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////
+#define QPEL_FILTER(src, stride)       \
+    (filter[0] * src[x - 3 * stride] + \
+     filter[1] * src[x - 2 * stride] + \
+     filter[2] * src[x - stride] +     \
+     filter[3] * src[x] +              \
+     filter[4] * src[x + stride] +     \
+     filter[5] * src[x + 2 * stride] + \
+     filter[6] * src[x + 3 * stride] + \
+     filter[7] * src[x + 4 * stride])
+
+// Per-fraction forms of QPEL_FILTER with the taps folded in as constants. The
+// half-pel filter is symmetric, so its taps are paired before the multiply;
+// the +/-1 taps of all three filters become plain adds and subtracts.
+#define QPEL_FILTER_1(src, stride)   \
+    (-src[x - 3 * stride] +          \
+     4 * src[x - 2 * stride] -       \
+     10 * src[x - stride] +          \
+     58 * src[x] +                   \
+     17 * src[x + stride] -          \
+     5 * src[x + 2 * stride] +       \
+     src[x + 3 * stride])
+
+#define QPEL_FILTER_2(src, stride)                       \
+    (40 * (src[x] + src[x + stride]) -                   \
+     11 * (src[x - stride] + src[x + 2 * stride]) +      \
+     4 * (src[x - 2 * stride] + src[x + 3 * stride]) -   \
+     (src[x - 3 * stride] + src[x + 4 * stride]))
+
+#define QPEL_FILTER_3(src, stride)   \
+    (src[x - 2 * stride] -           \
+     5 * src[x - stride] +           \
+     17 * src[x] +                   \
+     58 * src[x + stride] -          \
+     10 * src[x + 2 * stride] +      \
+     4 * src[x + 3 * stride] -       \
+     src[x + 4 * stride])
+
+// calls the per-fraction kernel name_1 .. name_3 selected by frac (mx or my)
+#define QPEL_FRAC_DISPATCH(name, frac, args) \
+    switch (frac)                            \
+    {                                        \
+    case 1:                                  \
+        FUNC(name##_1) args;                 \
+        break;                               \
+    case 2:                                  \
+        FUNC(name##_2) args;                 \
+        break;                               \
+    default:                                 \
+        FUNC(name##_3) args;                 \
+        break;                               \
+    }
+
+#if BIT_DEPTH < 14
+#define QPEL_FRAC_OFFSET(shift) (1 << ((shift) - 1))
+#else
+#define QPEL_FRAC_OFFSET(shift) 0
+#endif
+
+// Generates the h (stride 1) or v (stride srcstride) kernels of one fraction.
+#define QPEL_FRAC_PUT(dir, F, stride)                                                    \
+    static void FUNC(put_hevc_qpel_##dir##_##F)(int16_t *dst,                            \
+                                                uint8_t *_src, ptrdiff_t _srcstride,     \
+                                                int height, intptr_t mx, intptr_t my,    \
+                                                int width)                               \
+    {                                                                                    \
+        int x, y;                                                                        \
+        pixel *src = (pixel *)_src;                                                      \
+        ptrdiff_t srcstride = _srcstride / sizeof(pixel);                                \
+        for (y = 0; y < height; y++)                                                     \
+        {                                                                                \
+            for (x = 0; x < width; x++)                                                  \
+            {                                                                            \
+                dst[x] = QPEL_FILTER_##F(src, stride) >> (BIT_DEPTH - 8);                \
+            }                                                                            \
+            src += srcstride;                                                            \
+            dst += MAX_PB_SIZE;                                                          \
+        }                                                                                \
+    }
+
+#define QPEL_FRAC_UNI(dir, F, stride)                                                                           \
+    static uhd_always_inline void FUNC(put_hevc_qpel_uni_##dir##_##F)(uint8_t *_dst, ptrdiff_t _dststride,      \
+                                                                      uint8_t *_src, ptrdiff_t _srcstride,      \
+                                                                      int height, intptr_t mx, intptr_t my,     \
+                                                                      int width, int nt)                        \
+    {                                                                                                           \
+        int x, y;                                                                                               \
+        pixel *src = (pixel *)_src;                                                                             \
+        ptrdiff_t srcstride = _srcstride / sizeof(pixel);                                                       \
+        pixel *dst = (pixel *)_dst;                                                                             \
+        ptrdiff_t dststride = _dststride / sizeof(pixel);                                                       \
+        int shift = 14 - BIT_DEPTH;                                                                             \
+        int offset = QPEL_FRAC_OFFSET(shift);                                                                   \
+                                                                                                                \
+        for (y = 0; y < height; y++)                                                                            \
+        {                                                                                                       \
+            UHD_PUT_ROW(dst, width, nt, x,                                                                      \
+                        uhd_clip_pixel(((QPEL_FILTER_##F(src, stride) >> (BIT_DEPTH - 8)) + offset) >> shift)); \
+            src += srcstride;                                                                                   \
+            dst += dststride;                                                                                   \
+        }                                                                                                       \
+    }
+
+#define QPEL_FRAC_BI(dir, F, stride)                                                                       \
+    static uhd_always_inline void FUNC(put_hevc_qpel_bi_##dir##_##F)(uint8_t *_dst, ptrdiff_t _dststride,  \
+                                                                     uint8_t *_src, ptrdiff_t _srcstride,  \
+                                                                     int16_t *src2,                        \
+                                                                     int height, intptr_t mx, intptr_t my, \
+                                                                     int width, int nt)                    \
+    {                                                                                                      \
+        int x, y;                                                                                          \
+        pixel *src = (pixel *)_src;                                                                        \
+        ptrdiff_t srcstride = _srcstride / sizeof(pixel);                                                  \
+        pixel *dst = (pixel *)_dst;                                                                        \
+        ptrdiff_t dststride = _dststride / sizeof(pixel);                                                  \
+        int shift = 14 + 1 - BIT_DEPTH;                                                                    \
+        int offset = QPEL_FRAC_OFFSET(shift);                                                              \
+                                                                                                           \
+        for (y = 0; y < height; y++)                                                                       \
+        {                                                                                                  \
+            UHD_PUT_ROW(dst, width, nt, x,                                                                 \
+                        uhd_clip_pixel(((QPEL_FILTER_##F(src, stride) >> (BIT_DEPTH - 8)) + src2[x] +      \
+                                        offset) >> shift));                                                \
+            src += srcstride;                                                                              \
+            dst += dststride;                                                                              \
+            src2 += MAX_PB_SIZE;                                                                           \
+        }                                                                                                  \
+    }
+
+#define QPEL_FRAC_UNI_W(dir, F, stride)                                                                              \
+    static uhd_always_inline void FUNC(put_hevc_qpel_uni_w_##dir##_##F)(uint8_t *_dst, ptrdiff_t _dststride,         \
+                                                                        uint8_t *_src, ptrdiff_t _srcstride,         \
+                                                                        int height, int denom, int wx, int ox,       \
+                                                                        intptr_t mx, intptr_t my, int width, int nt) \
+    {                                                                                                                \
+        int x, y;                                                                                                    \
+        pixel *src = (pixel *)_src;                                                                                  \
+        ptrdiff_t srcstride = _srcstride / sizeof(pixel);                                                            \
+        pixel *dst = (pixel *)_dst;                                                                                  \
+        ptrdiff_t dststride = _dststride / sizeof(pixel);                                                            \
+        int shift = denom + 14 - BIT_DEPTH;                                                                          \
+        int offset = QPEL_FRAC_OFFSET(shift);                                                                        \
+                                                                                                                     \
+        ox = ox * (1 << (BIT_DEPTH - 8));                                                                            \
+        for (y = 0; y < height; y++)                                                                                 \
+        {                                                                                                            \
+            UHD_PUT_ROW(dst, width, nt, x,                                                                           \
+                        uhd_clip_pixel((((QPEL_FILTER_##F(src, stride) >> (BIT_DEPTH - 8)) * wx +                    \
+                                         offset) >> shift) + ox));                                                   \
+            src += srcstride;                                                                                        \
+            dst += dststride;                                                                                        \
+        }                                                                                                            \
+    }
+
+#define QPEL_FRAC_BI_W(dir, F, stride)                                                                             \
+    static uhd_always_inline void FUNC(put_hevc_qpel_bi_w_##dir##_##F)(uint8_t *_dst, ptrdiff_t _dststride,        \
+                                                                       uint8_t *_src, ptrdiff_t _srcstride,        \
+                                                                       int16_t *src2,                              \
+                                                                       int height, int denom, int wx0, int wx1,    \
+                                                                       int ox0, int ox1, intptr_t mx, intptr_t my, \
+                                                                       int width, int nt)                          \
+    {                                                                                                              \
+        int x, y;                                                                                                  \
+        pixel *src = (pixel *)_src;                                                                                \
+        ptrdiff_t srcstride = _srcstride / sizeof(pixel);                                                          \
+        pixel *dst = (pixel *)_dst;                                                                                \
+        ptrdiff_t dststride = _dststride / sizeof(pixel);                                                          \
+        int shift = 14 + 1 - BIT_DEPTH;                                                                            \
+        int log2Wd = denom + shift - 1;                                                                            \
+                                                                                                                   \
+        ox0 = ox0 * (1 << (BIT_DEPTH - 8));                                                                        \
+        ox1 = ox1 * (1 << (BIT_DEPTH - 8));                                                                        \
+        for (y = 0; y < height; y++)                                                                               \
+        {                                                                                                          \
+            UHD_PUT_ROW(dst, width, nt, x,                                                                         \
+                        uhd_clip_pixel(((QPEL_FILTER_##F(src, stride) >> (BIT_DEPTH - 8)) * wx1 +                  \
+                                        src2[x] * wx0 + ((ox0 + ox1 + 1) << log2Wd)) >>                            \
+                                       (log2Wd + 1)));                                                             \
+            src += srcstride;                                                                                      \
+            dst += dststride;                                                                                      \
+            src2 += MAX_PB_SIZE;                                                                                   \
+        }                                                                                                          \
+    }
+
+#define QPEL_FRAC_FUNCS(dir, F, stride) \
+    QPEL_FRAC_PUT(dir, F, stride)       \
+    QPEL_FRAC_UNI(dir, F, stride)       \
+    QPEL_FRAC_BI(dir, F, stride)        \
+    QPEL_FRAC_UNI_W(dir, F, stride)     \
+    QPEL_FRAC_BI_W(dir, F, stride)
+
+QPEL_FRAC_FUNCS(h, 1, 1)
+QPEL_FRAC_FUNCS(h, 2, 1)
+QPEL_FRAC_FUNCS(h, 3, 1)
+QPEL_FRAC_FUNCS(v, 1, srcstride)
+QPEL_FRAC_FUNCS(v, 2, srcstride)
+QPEL_FRAC_FUNCS(v, 3, srcstride)
+
+#undef QPEL_FRAC_FUNCS
+#undef QPEL_FRAC_PUT
+#undef QPEL_FRAC_UNI
+#undef QPEL_FRAC_BI
+#undef QPEL_FRAC_UNI_W
+#undef QPEL_FRAC_BI_W
+#undef QPEL_FRAC_OFFSET
+
+// Packed processing of 2- and 4-wide blocks: one int16x8 vector holds 8 / width
+// rows of the block, so narrow PUs fill whole registers. Both passes of the hv
+// form keep the first-pass rows back to back at a stride of width, so the
+// vector at row r already holds rows r .. r + 8 / width - 1 for every tap.
+#ifndef UHD_PACKED
+#define UHD_PACKED
+#ifdef UHD_KERNEL_BENCH
+// set by uhd_bench_run to time the row kernels on the blocks packing covers
+static int uhd_packed_off;
+#endif
+
+static inline int uhd_use_packed(int width, int height)
+{
+#ifdef UHD_KERNEL_BENCH
+    if (uhd_packed_off)
+    {
+        return 0;
+    }
+#endif
+    return (width == 2 || width == 4) && !(height % (8 / width));
+}
+
+static inline void uhd_packed_qpel_taps(int16x8_t *fil, intptr_t frac)
+{
+    int k;
+
+    for (k = 0; k < 8; k++)
+    {
+        fil[k] = vdupq_n_s16(qpel_filter_size8[frac - 1][k]);
+    }
+}
+
+static inline void uhd_packed_epel_taps(int16x8_t *fil, intptr_t frac)
+{
+    int k;
+
+    for (k = 0; k < 4; k++)
+    {
+        fil[k] = vdupq_n_s16(uhd_hevc_epel_filters[frac - 1][k]);
+    }
+}
+#endif
+
+// width pixels from each of 8 / width rows; rows past the first nrows repeat
+// the last one, so nothing below the filter window is read. Each row is one
+// lane load straight into the vector.
+static uhd_always_inline int16x8_t FUNC(load_packed)(const pixel *src, ptrdiff_t srcstride, int width, int nrows)
+{
+    const pixel *row[4];
+    int i;
+
+    for (i = 0; i < 8 / width; i++)
+    {
+        row[i] = src + (i < nrows ? i : nrows - 1) * srcstride;
+    }
+#if BIT_DEPTH > 8
+    if (width == 4)
+    {
+        return vreinterpretq_s16_u16(vcombine_u16(vld1_u16(row[0]), vld1_u16(row[1])));
+    }
+    else
+    {
+        uint32x4_t v = vdupq_n_u32(0);
+
+        v = vld1q_lane_u32((const uint32_t *)row[0], v, 0);
+        v = vld1q_lane_u32((const uint32_t *)row[1], v, 1);
+        v = vld1q_lane_u32((const uint32_t *)row[2], v, 2);
+        v = vld1q_lane_u32((const uint32_t *)row[3], v, 3);
+        return vreinterpretq_s16_u32(v);
+    }
+#else
+    if (width == 4)
+    {
+        uint32x2_t v = vdup_n_u32(0);
+
+        v = vld1_lane_u32((const uint32_t *)row[0], v, 0);
+        v = vld1_lane_u32((const uint32_t *)row[1], v, 1);
+        return vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(v)));
+    }
+    else
+    {
+        uint16x4_t v = vdup_n_u16(0);
+
+        v = vld1_lane_u16((const uint16_t *)row[0], v, 0);
+        v = vld1_lane_u16((const uint16_t *)row[1], v, 1);
+        v = vld1_lane_u16((const uint16_t *)row[2], v, 2);
+        v = vld1_lane_u16((const uint16_t *)row[3], v, 3);
+        return vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u16(v)));
+    }
+#endif
+}
+
+// the 8 / width rows of v, one lane store each
+static uhd_always_inline void FUNC(store_packed)(int16_t *dst, ptrdiff_t dststride, int16x8_t v, int width)
+{
+    if (width == 4)
+    {
+        uint64x2_t w = vreinterpretq_u64_s16(v);
+
+        vst1q_lane_u64((uint64_t *)dst, w, 0);
+        vst1q_lane_u64((uint64_t *)(dst + dststride), w, 1);
+    }
+    else
+    {
+        uint32x4_t w = vreinterpretq_u32_s16(v);
+
+        vst1q_lane_u32((uint32_t *)dst, w, 0);
+        vst1q_lane_u32((uint32_t *)(dst + dststride), w, 1);
+        vst1q_lane_u32((uint32_t *)(dst + 2 * dststride), w, 2);
+        vst1q_lane_u32((uint32_t *)(dst + 3 * dststride), w, 3);
+    }
+}
+
+// ntaps-tap filter (taps at -(ntaps / 2 - 1) .. ntaps / 2 times step) over
+// packed rows, >> (BIT_DEPTH - 8) as in QPEL_FILTER / EPEL_FILTER. Deeper
+// samples use the hi/lo split of qpel_filter_row.
+static uhd_always_inline int16x8_t FUNC(filter_packed)(const pixel *src, ptrdiff_t srcstride, ptrdiff_t step,
+                                                       int width, int nrows, const int16x8_t *fil, int ntaps)
+{
+    int16x8_t sum = vdupq_n_s16(0);
+    int k;
+#if BIT_DEPTH > 8
+    int16x8_t lo_sum = vdupq_n_s16(0);
+    int16x8_t lo_mask = vdupq_n_s16((1 << (BIT_DEPTH - 8)) - 1);
+#endif
+
+    src -= (ntaps / 2 - 1) * step;
+    for (k = 0; k < ntaps; k++)
+    {
+        int16x8_t px = FUNC(load_packed)(src + k * step, srcstride, width, nrows);
+#if BIT_DEPTH > 8
+        lo_sum = vmlaq_s16(lo_sum, vandq_s16(px, lo_mask), fil[k]);
+        px = vshrq_n_s16(px, BIT_DEPTH - 8);
+#endif
+        sum = vmlaq_s16(sum, px, fil[k]);
+    }
+#if BIT_DEPTH > 8
+    sum = vaddq_s16(sum, vshrq_n_s16(lo_sum, BIT_DEPTH - 8));
+#endif
+    return sum;
+}
+
+// 14-bit h (step 1) or v (step srcstride) prediction of a packed block
+static void FUNC(put_hevc_packed)(int16_t *dst, pixel *src, ptrdiff_t srcstride, ptrdiff_t step,
+                                  const int16x8_t *fil, int ntaps, int height, int width)
+{
+    int y;
+    int rows = 8 / width;
+
+    for (y = 0; y < height; y += rows)
+    {
+        FUNC(store_packed)(dst, MAX_PB_SIZE, FUNC(filter_packed)(src, srcstride, step, width, rows, fil, ntaps), width);
+        src += rows * srcstride;
+        dst += rows * MAX_PB_SIZE;
+    }
+}
+
+static void FUNC(put_hevc_qpel_h)(int16_t *dst,
+                                  uint8_t *_src, ptrdiff_t _srcstride,
+                                  int height, intptr_t mx, intptr_t my, int width)
+{
+    if (uhd_use_packed(width, height))
+    {
+        int16x8_t fil[8];
+
+        uhd_packed_qpel_taps(fil, mx);
+        FUNC(put_hevc_packed)(dst, (pixel *)_src, _srcstride / sizeof(pixel), 1, fil, 8, height, width);
+        return;
+    }
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_h, mx, (dst, _src, _srcstride, height, mx, my, width));
+}
+
+static void FUNC(put_hevc_qpel_v)(int16_t *dst,
+                                  uint8_t *_src, ptrdiff_t _srcstride,
+                                  int height, intptr_t mx, intptr_t my, int width)
+{
+    if (uhd_use_packed(width, height))
+    {
+        int16x8_t fil[8];
+
+        uhd_packed_qpel_taps(fil, my);
+        FUNC(put_hevc_packed)(dst, (pixel *)_src, _srcstride / sizeof(pixel), _srcstride / sizeof(pixel), fil, 8,
+                              height, width);
+        return;
+    }
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_v, my, (dst, _src, _srcstride, height, mx, my, width));
+}
+
+// The hv kernels keep a sliding window of the last QPEL_RING_ROWS (EPEL_RING_ROWS)
+// horizontally filtered rows instead of the whole (height + QPEL_EXTRA) block,
+// so every output row is produced as soon as its input rows exist.
+// Ring rows are ring_stride apart: the block width rounded up to one 8-lane
+// vector, so small PUs touch a few cache lines instead of MAX_PB_SIZE wide rows.
+#define QPEL_RING_ROWS (QPEL_EXTRA + 1)
+#define EPEL_RING_ROWS (EPEL_EXTRA + 1)
+#define RING_STRIDE(width) (((width) + 7) & ~7)
+#define RING_ROW(ring, nb_rows, y) ((ring) + ((y) & ((nb_rows) - 1)) * ring_stride)
+
+#define QPEL_FILTER_ROWS(rows)   \
+    (filter[0] * rows[0][x] +    \
+     filter[1] * rows[1][x] +    \
+     filter[2] * rows[2][x] +    \
+     filter[3] * rows[3][x] +    \
+     filter[4] * rows[4][x] +    \
+     filter[5] * rows[5][x] +    \
+     filter[6] * rows[6][x] +    \
+     filter[7] * rows[7][x])
+
+// START OF THE FUNCTION  -> QPEL_HV
+#define VECTOR_LOGIC2_LOOP1
+#define VECTOR_LOGIC2_LOOP2
+
+// first pass of one row (taps step pixels apart: 1 for h, srcstride for v),
+// shared by the vector hv kernels and the bi-prediction kernel
+// eight taps over eight lanes of 8-bit-range samples, accumulated in int16
+static uhd_always_inline int16x8_t FUNC(qpel_filter_taps)(const int16x8_t *px, const int16x8_t *fil, int half_pel)
+{
+    int16x8_t sum;
+    int k;
+
+    if (half_pel)
+    {
+        sum = vmulq_s16(vaddq_s16(px[3], px[4]), fil[3]);
+        sum = vmlaq_s16(sum, vaddq_s16(px[2], px[5]), fil[2]);
+        sum = vmlaq_s16(sum, vaddq_s16(px[1], px[6]), fil[1]);
+        return vsubq_s16(sum, vaddq_s16(px[0], px[7]));
+    }
+    sum = vmulq_s16(px[0], fil[0]);
+    for (k = 1; k < 8; k++)
+    {
+        sum = vmlaq_s16(sum, px[k], fil[k]);
+    }
+    return sum;
+}
+
+static uhd_always_inline void FUNC(qpel_filter_row)(int16_t *tmp, pixel *src, ptrdiff_t step,
+                                                    const int16_t *filter, int width)
+{
+    int x;
+
+#ifdef SCALAR_LOOP1
+    for (x = 0; x < width; x++)
+    {
+        tmp[x] = QPEL_FILTER(src, step) >> (BIT_DEPTH - 8);
+    }
+#endif
+
+#ifdef VECTOR_LOGIC2_LOOP1
+    // the half-pel filter is symmetric: pair its taps and turn the -1 taps into a subtract
+    int half_pel = filter[3] == filter[4];
+    int16x8_t fil[8];
+    int16x8_t px[8];
+    int k;
+#if BIT_DEPTH > 8
+    int16x8_t lo[8];
+    int16x8_t lo_mask = vdupq_n_s16((1 << (BIT_DEPTH - 8)) - 1);
+#endif
+
+    for (k = 0; k < 8; k++)
+    {
+        fil[k] = vdupq_n_s16(filter[k]);
+    }
+
+    for (x = 0; x < width; x += 8)
+    {
+        for (k = 0; k < 8; k++)
+        {
+            px[k] = FUNC(pel_load8)(src + x + (k - 3) * step);
+        }
+#if BIT_DEPTH > 8
+        // p = (hi << (BIT_DEPTH - 8)) + lo with hi in [0, 255], so the hi sum has the
+        // 8-bit range and the lo sum is at most 112 * lo; both stay in int16. The hi
+        // term is a multiple of 1 << (BIT_DEPTH - 8), so
+        // sum(f * p) >> (BIT_DEPTH - 8) == sum(f * hi) + (sum(f * lo) >> (BIT_DEPTH - 8)).
+        for (k = 0; k < 8; k++)
+        {
+            lo[k] = vandq_s16(px[k], lo_mask);
+            px[k] = vshrq_n_s16(px[k], BIT_DEPTH - 8);
+        }
+        vst1q_s16(tmp + x, vaddq_s16(FUNC(qpel_filter_taps)(px, fil, half_pel),
+                                     vshrq_n_s16(FUNC(qpel_filter_taps)(lo, fil, half_pel), BIT_DEPTH - 8)));
+#else
+        vst1q_s16(tmp + x, FUNC(qpel_filter_taps)(px, fil, half_pel));
+#endif
+    }
+#endif
+}
+
+// scalar horizontal pass of one row into the ring, used by the weighted hv kernels
+static uhd_always_inline void FUNC(qpel_hv_filter_row_c)(int16_t *tmp, pixel *src,
+                                                         const int8_t *filter, int width)
+{
+    int x;
+
+    for (x = 0; x < width; x++)
+    {
+        tmp[x] = QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+    }
+}
+
+// vertical pass over the eight ring rows for lanes x .. x + 7, widened to int32
+static uhd_always_inline int32x4x2_t FUNC(qpel_hv_filter_col)(int16_t **rows, int x,
+                                                              const int16x4_t *filt)
+{
+    int32x4x2_t final;
+    int k;
+
+    final.val[0] = vdupq_n_s32(0);
+    final.val[1] = vdupq_n_s32(0);
+    for (k = 0; k < QPEL_RING_ROWS; k++)
+    {
+        final.val[0] = vmlal_s16(final.val[0], vld1_s16(rows[k] + x), filt[k]);
+        final.val[1] = vmlal_s16(final.val[1], vld1_s16(rows[k] + x + 4), filt[k]);
+    }
+    return final;
+}
+
+// Splits a first-pass row as t = 128 * hi + lo (hi = t >> 7, lo = t & 127), hi in
+// place and lo into lo_row, once per ring row rather than once per use.
+static uhd_always_inline void FUNC(qpel_hv_split_row)(int16_t *row, int16_t *lo_row, int width)
+{
+    int x;
+    int16x8_t mask = vdupq_n_s16(127);
+
+    for (x = 0; x < width; x += 8)
+    {
+        int16x8_t t = vld1q_s16(row + x);
+
+        vst1q_s16(lo_row + x, vandq_s16(t, mask));
+        vst1q_s16(row + x, vshrq_n_s16(t, 7));
+    }
+}
+
+// Vertical pass for lanes x .. x + 7 without leaving int16.
+// At every bit depth the first pass keeps t in [-6143, 22522], so hi is in [-48, 175] and lo in
+// [0, 127]. With the largest tap sums (88 positive, 24 negative, half-pel)
+// Q = sum(f * hi) stays in [-8424, 16552] and L = sum(f * lo) in [-3048, 11176].
+// Since S = 128 * Q + L, S >> 6 == 2 * Q + (L >> 6) exactly; only the final add
+// can leave int16 and it saturates, matching the vqmovn of the int32 path.
+static uhd_always_inline int16x8_t FUNC(qpel_hv_filter_col16)(int16_t **hi, int16_t **lo, int x,
+                                                               const int16x8_t *filt, int half_pel)
+{
+    int16x8_t q, l;
+    int k;
+
+    if (half_pel)
+    {
+        q = vmulq_s16(vaddq_s16(vld1q_s16(hi[3] + x), vld1q_s16(hi[4] + x)), filt[3]);
+        q = vmlaq_s16(q, vaddq_s16(vld1q_s16(hi[2] + x), vld1q_s16(hi[5] + x)), filt[2]);
+        q = vmlaq_s16(q, vaddq_s16(vld1q_s16(hi[1] + x), vld1q_s16(hi[6] + x)), filt[1]);
+        q = vsubq_s16(q, vaddq_s16(vld1q_s16(hi[0] + x), vld1q_s16(hi[7] + x)));
+
+        l = vmulq_s16(vaddq_s16(vld1q_s16(lo[3] + x), vld1q_s16(lo[4] + x)), filt[3]);
+        l = vmlaq_s16(l, vaddq_s16(vld1q_s16(lo[2] + x), vld1q_s16(lo[5] + x)), filt[2]);
+        l = vmlaq_s16(l, vaddq_s16(vld1q_s16(lo[1] + x), vld1q_s16(lo[6] + x)), filt[1]);
+        l = vsubq_s16(l, vaddq_s16(vld1q_s16(lo[0] + x), vld1q_s16(lo[7] + x)));
+    }
+    else
+    {
+        q = vdupq_n_s16(0);
+        l = vdupq_n_s16(0);
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            q = vmlaq_s16(q, vld1q_s16(hi[k] + x), filt[k]);
+            l = vmlaq_s16(l, vld1q_s16(lo[k] + x), filt[k]);
+        }
+    }
+    return vqaddq_s16(q, vaddq_s16(q, vshrq_n_s16(l, 6)));
+}
+
+// 14-bit hv prediction of a packed block (see load_packed). The vertical pass is the int16
+// 128 * hi + lo split of qpel_hv_filter_col16; the epel first pass has a
+// narrower range than qpel, so the same bounds hold for both.
+static void FUNC(put_hevc_hv_packed)(int16_t *dst, pixel *src, ptrdiff_t srcstride, const int16x8_t *fil_h,
+                                     const int16x8_t *fil_v, int ntaps, int height, int width)
+{
+    int16_t hi[(MAX_PB_SIZE + 8) * 4];
+    int16_t lo[(MAX_PB_SIZE + 8) * 4];
+    int rows = 8 / width;
+    int total = height + ntaps - 1;
+    int y, k;
+
+    src -= (ntaps / 2 - 1) * srcstride;
+    for (y = 0; y < total; y += rows)
+    {
+        vst1q_s16(hi + y * width, FUNC(filter_packed)(src + y * srcstride, srcstride, 1, width, total - y, fil_h, ntaps));
+    }
+    FUNC(qpel_hv_split_row)(hi, lo, (total + rows - 1) / rows * 8);
+
+    for (y = 0; y < height; y += rows)
+    {
+        int16x8_t q = vdupq_n_s16(0);
+        int16x8_t l = vdupq_n_s16(0);
+
+        for (k = 0; k < ntaps; k++)
+        {
+            q = vmlaq_s16(q, vld1q_s16(hi + (y + k) * width), fil_v[k]);
+            l = vmlaq_s16(l, vld1q_s16(lo + (y + k) * width), fil_v[k]);
+        }
+        FUNC(store_packed)(dst, MAX_PB_SIZE, vqaddq_s16(q, vaddq_s16(q, vshrq_n_s16(l, 6))), width);
+        dst += rows * MAX_PB_SIZE;
+    }
+}
+
+static void FUNC(put_hevc_qpel_hv)(int16_t *dst,
+                                   uint8_t *_src,
+                                   ptrdiff_t _srcstride,
+                                   int height, intptr_t mx,
+                                   intptr_t my, int width)
+{
+    int x, y, k;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    int16_t tmp_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[QPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
+#ifdef VECTOR_LOGIC2_LOOP2
+    int16_t lo_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *lo_rows[QPEL_RING_ROWS];
+#endif
+    const int16_t *filter_h = qpel_filter_size8[mx - 1];
+    const int16_t *filter = qpel_filter_size8[my - 1];
+
+    if (uhd_use_packed(width, height))
+    {
+        int16x8_t fil_h[8], fil_v[8];
+
+        uhd_packed_qpel_taps(fil_h, mx);
+        uhd_packed_qpel_taps(fil_v, my);
+        FUNC(put_hevc_hv_packed)(dst, src, srcstride, fil_h, fil_v, 8, height, width);
+        return;
+    }
+
+    src -= QPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < QPEL_EXTRA; y++)
+    {
+        FUNC(qpel_filter_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y), src, 1, filter_h, width);
+#ifdef VECTOR_LOGIC2_LOOP2
+        FUNC(qpel_hv_split_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y),
+                                RING_ROW(lo_array, QPEL_RING_ROWS, y), width);
+#endif
+        src += srcstride;
+    }
+
+#ifdef VECTOR_LOGIC2_LOOP2
+    int16x8_t filt[QPEL_RING_ROWS];
+    int half_pel = filter[3] == filter[4];
+    for (k = 0; k < QPEL_RING_ROWS; k++)
+    {
+        filt[k] = vdupq_n_s16(filter[k]);
+    }
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        FUNC(qpel_filter_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA), src, 1, filter_h, width);
+#ifdef VECTOR_LOGIC2_LOOP2
+        FUNC(qpel_hv_split_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA),
+                                RING_ROW(lo_array, QPEL_RING_ROWS, y + QPEL_EXTRA), width);
+#endif
+        src += srcstride;
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, QPEL_RING_ROWS, y + k);
+        }
+
+#ifdef SCALAR_LOOP2
+        for (x = 0; x < width; x++)
+        {
+            dst[x] = QPEL_FILTER_ROWS(rows) >> 6;
+        }
+#endif
+
+#ifdef VECTOR_LOGIC2_LOOP2
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            lo_rows[k] = RING_ROW(lo_array, QPEL_RING_ROWS, y + k);
+        }
+        for (x = 0; x < width; x += 8)
+        {
+            vst1q_s16(dst + x, FUNC(qpel_hv_filter_col16)(rows, lo_rows, x, filt, half_pel));
+        }
+#endif
+        dst += MAX_PB_SIZE;
+    }
+}
+// END OF THE FUNCTION
+
+#ifdef UHD_KERNEL_SELFTEST
+// Checks qpel_hv_filter_col16 against the int32 qpel_hv_filter_col (with the
+// vqmovn narrowing of its callers) over the whole first-pass range. For each
+// filter, with and without the half-pel tap pairing, every row sweeps the
+// range while the other rows sit at one of four extreme backgrounds (all
+// low, all high, and the two that maximize and minimize the sum). Then all
+// 256 low/high row patterns are tried. Returns the number of mismatching
+// lanes.
+static int FUNC(selftest_qpel_hv_filter_col16)(void)
+{
+    enum { T_MIN = -6143, T_MAX = 22522 };
+    int16_t t[QPEL_RING_ROWS][8], hi[QPEL_RING_ROWS][8], lo[QPEL_RING_ROWS][8];
+    int16_t *t_rows[QPEL_RING_ROWS], *hi_rows[QPEL_RING_ROWS], *lo_rows[QPEL_RING_ROWS];
+    int16x8_t filt[QPEL_RING_ROWS];
+    int16x4_t filt32[QPEL_RING_ROWS];
+    int frac, pairing, bg, row, base, pattern, k, x;
+    int fails = 0;
+
+    for (k = 0; k < QPEL_RING_ROWS; k++)
+    {
+        t_rows[k] = t[k];
+        hi_rows[k] = hi[k];
+        lo_rows[k] = lo[k];
+    }
+
+    for (frac = 0; frac < 3; frac++)
+    {
+        const int16_t *filter = qpel_filter_size8[frac];
+
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            filt[k] = vdupq_n_s16(filter[k]);
+            filt32[k] = vdup_n_s16(filter[k]);
+        }
+        for (pairing = 0; pairing <= (filter[3] == filter[4]); pairing++)
+        {
+            for (bg = 0; bg < 4 + 256; bg++)
+            {
+                for (row = -1; row < (bg < 4 ? QPEL_RING_ROWS : 0); row++)
+                {
+                    for (base = T_MIN; base <= (row < 0 ? T_MIN : T_MAX); base += 8)
+                    {
+                        for (k = 0; k < QPEL_RING_ROWS; k++)
+                        {
+                            int high = bg == 0   ? 0
+                                       : bg == 1 ? 1
+                                       : bg == 2 ? filter[k] > 0
+                                       : bg == 3 ? filter[k] < 0
+                                                 : (bg - 4) >> k & 1;
+
+                            for (x = 0; x < 8; x++)
+                            {
+                                t[k][x] = k == row ? UHDMIN(base + x, T_MAX) : high ? T_MAX : T_MIN;
+                            }
+                            memcpy(hi[k], t[k], sizeof(t[k]));
+                            FUNC(qpel_hv_split_row)(hi[k], lo[k], 8);
+                        }
+
+                        int32x4x2_t ref = FUNC(qpel_hv_filter_col)(t_rows, 0, filt32);
+                        int16x8_t want = vcombine_s16(vqmovn_s32(vshrq_n_s32(ref.val[0], 6)),
+                                                      vqmovn_s32(vshrq_n_s32(ref.val[1], 6)));
+                        int16x8_t got = FUNC(qpel_hv_filter_col16)(hi_rows, lo_rows, 0, filt, pairing);
+                        uint16x8_t same = vceqq_s16(want, got);
+
+                        fails += 8 - vaddvq_u16(vshrq_n_u16(same, 15));
+                    }
+                }
+            }
+        }
+    }
+    return fails;
+}
+#endif
+
+static uhd_always_inline void FUNC(put_hevc_qpel_uni_h_store)(uint8_t *_dst, ptrdiff_t _dststride,
+                                                              uint8_t *_src, ptrdiff_t _srcstride,
+                                                              int height, intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_uni_h, mx, (_dst, _dststride, _src, _srcstride, height, mx, my, width, nt));
+}
+
+PUT_NT_UNI(put_hevc_qpel_uni_h)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_bi_h_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                             ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                             intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_bi_h, mx, (_dst, _dststride, _src, _srcstride, src2, height, mx, my, width, nt));
+}
+
+PUT_NT_BI(put_hevc_qpel_bi_h)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_uni_v_store)(uint8_t *_dst, ptrdiff_t _dststride,
+                                                              uint8_t *_src, ptrdiff_t _srcstride,
+                                                              int height, intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_uni_v, my, (_dst, _dststride, _src, _srcstride, height, mx, my, width, nt));
+}
+
+PUT_NT_UNI(put_hevc_qpel_uni_v)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_bi_v_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                             ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                             intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_bi_v, my, (_dst, _dststride, _src, _srcstride, src2, height, mx, my, width, nt));
+}
+
+PUT_NT_BI(put_hevc_qpel_bi_v)
+
+// START OF QPEL_UNI_HV
+
+#define QPEL_UNI_VECTOR2
+
+// ring_stride is RING_STRIDE(width) in the kernels; the benchmark also runs
+// the MAX_PB_SIZE stride the ring used to have
+static uhd_always_inline void FUNC(put_hevc_qpel_uni_hv_ring)(uint8_t *_dst, ptrdiff_t _dststride,
+                                                              uint8_t *_src, ptrdiff_t _srcstride,
+                                                              int height, intptr_t mx, intptr_t my, int width,
+                                                              int ring_stride, int nt)
+{
+    int x, y, k;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    int16_t tmp_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[QPEL_RING_ROWS];
+#ifdef QPEL_UNI_VECTOR2
+    int16_t lo_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *lo_rows[QPEL_RING_ROWS];
+#endif
+    const int16_t *filter_h = qpel_filter_size8[mx - 1];
+    int shift = 14 - BIT_DEPTH;
+
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    src -= QPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < QPEL_EXTRA; y++)
+    {
+        FUNC(qpel_filter_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y), src, 1, filter_h, width);
+#ifdef QPEL_UNI_VECTOR2
+        FUNC(qpel_hv_split_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y),
+                                RING_ROW(lo_array, QPEL_RING_ROWS, y), width);
+#endif
+        src += srcstride;
+    }
+
+#ifdef QPEL_UNI_SCALAR2
+    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
+#endif
+
+#ifdef QPEL_UNI_VECTOR2
+    const int16_t *filter_v = qpel_filter_size8[my - 1];
+    int16x8_t offvector = vdupq_n_s16(offset);
+    int16x8_t max = vdupq_n_s16((1 << BIT_DEPTH) - 1);
+    int16x8_t min = vdupq_n_s16(0);
+    int16x8_t filt[QPEL_RING_ROWS];
+    int half_pel = filter_v[3] == filter_v[4];
+
+    for (k = 0; k < QPEL_RING_ROWS; k++)
+    {
+        filt[k] = vdupq_n_s16(filter_v[k]);
+    }
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        FUNC(qpel_filter_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA), src, 1, filter_h, width);
+#ifdef QPEL_UNI_VECTOR2
+        FUNC(qpel_hv_split_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA),
+                                RING_ROW(lo_array, QPEL_RING_ROWS, y + QPEL_EXTRA), width);
+#endif
+        src += srcstride;
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, QPEL_RING_ROWS, y + k);
+        }
+
+#ifdef QPEL_UNI_SCALAR2
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((QPEL_FILTER_ROWS(rows) >> 6) + offset) >> shift));
+#endif
+
+#ifdef QPEL_UNI_VECTOR2
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            lo_rows[k] = RING_ROW(lo_array, QPEL_RING_ROWS, y + k);
+        }
+        for (x = 0; x < width; x += 8)
+        {
+            int16x8_t combined = FUNC(qpel_hv_filter_col16)(rows, lo_rows, x, filt, half_pel);
+
+            int16x8_t result = vqaddq_s16(combined, offvector);
+            result = vshrq_n_s16(result, shift);
+
+            uint16x8_t clip00 = vreinterpretq_u16_s16((vminq_s16(max, vmaxq_s16(min, result))));
+
+            FUNC(store_pixels8_hint)(dst + x, clip00, nt);
+        }
+#endif
+        dst += dststride;
+    }
+}
+
+static uhd_always_inline void FUNC(put_hevc_qpel_uni_hv_store)(uint8_t *_dst, ptrdiff_t _dststride,
+                                                               uint8_t *_src, ptrdiff_t _srcstride,
+                                                               int height, intptr_t mx, intptr_t my, int width, int nt)
+{
+    FUNC(put_hevc_qpel_uni_hv_ring)(_dst, _dststride, _src, _srcstride, height, mx, my, width, RING_STRIDE(width), nt);
+}
+
+PUT_NT_UNI(put_hevc_qpel_uni_hv)
+
+// START OF THE FUNCTION - QPEL_BI_HV
+#define BI_VECTOR2
+
+static uhd_always_inline void FUNC(put_hevc_qpel_bi_hv_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                              ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                              intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y, k;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    int16_t tmp_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[QPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
+#ifdef BI_VECTOR2
+    int16_t lo_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *lo_rows[QPEL_RING_ROWS];
+#endif
+    const int16_t *filter_h = qpel_filter_size8[mx - 1];
+
+    int shift = 14 + 1 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    src -= QPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < QPEL_EXTRA; y++)
+    {
+        FUNC(qpel_filter_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y), src, 1, filter_h, width);
+#ifdef BI_VECTOR2
+        FUNC(qpel_hv_split_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y),
+                                RING_ROW(lo_array, QPEL_RING_ROWS, y), width);
+#endif
+        src += srcstride;
+    }
+
+#ifdef BI_SCALAR2
+    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
+#endif
+
+#ifdef BI_VECTOR2
+    const int16_t *filter_v = qpel_filter_size8[my - 1];
+    int16x8_t offvector = vdupq_n_s16(offset);
+    int32x4_t max = vdupq_n_s32((1 << BIT_DEPTH) - 1);
+    int32x4_t min = vdupq_n_s32(0);
+    int16x8_t filt[QPEL_RING_ROWS];
+    int half_pel = filter_v[3] == filter_v[4];
+
+    for (k = 0; k < QPEL_RING_ROWS; k++)
+    {
+        filt[k] = vdupq_n_s16(filter_v[k]);
+    }
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        FUNC(qpel_filter_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA), src, 1, filter_h, width);
+#ifdef BI_VECTOR2
+        FUNC(qpel_hv_split_row)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA),
+                                RING_ROW(lo_array, QPEL_RING_ROWS, y + QPEL_EXTRA), width);
+#endif
+        src += srcstride;
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, QPEL_RING_ROWS, y + k);
+        }
+
+#ifdef BI_SCALAR2
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((QPEL_FILTER_ROWS(rows) >> 6) + src2[x] + offset) >> shift));
+#endif
+
+#ifdef BI_VECTOR2
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            lo_rows[k] = RING_ROW(lo_array, QPEL_RING_ROWS, y + k);
+        }
+        for (x = 0; x < width; x += 8)
+        {
+            int16x8_t combined = FUNC(qpel_hv_filter_col16)(rows, lo_rows, x, filt, half_pel);
+
+            int16x8_t srcvector = vld1q_s16(src2 + x);
+
+            int16x8_t result1 = vqaddq_s16(combined, offvector);
+
+            int32x4_t result2 = vaddl_s16(vget_low_s16(result1), vget_low_s16(srcvector));
+            int32x4_t result3 = vaddl_s16(vget_high_s16(result1), vget_high_s16(srcvector));
+
+            result2 = vshrq_n_s32(result2, shift);
+            result3 = vshrq_n_s32(result3, shift);
+
+            uint16x4_t clip0 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, result2))));
+            uint16x4_t clip1 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, result3))));
+
+            FUNC(store_pixels8_hint)(dst + x, vcombine_u16(clip0, clip1), nt);
+        }
+#endif
+        dst += dststride;
+        src2 += MAX_PB_SIZE;
+    }
+}
+
+PUT_NT_BI(put_hevc_qpel_bi_hv)
+// END OF QPEL_BI_HV
+
+// START OF QPEL_BIPRED
+// Bi-prediction in one call: both references are interpolated a row at a time
+// into small int16 row buffers and averaged straight into dst, instead of going
+// through a MAX_PB_SIZE-stride src2 block written by a separate call.
+
+// row y of the 14-bit prediction of one reference; ring carries the hv window
+static uhd_always_inline void FUNC(qpel_bipred_row)(int16_t *dst, pixel *src, ptrdiff_t srcstride,
+                                                    int16_t *ring, int y, intptr_t mx, intptr_t my,
+                                                    int width)
+{
+    int x, k;
+
+    if (!mx && !my)
+    {
+        src += y * srcstride;
+        for (x = 0; x < width; x += 8)
+        {
+            vst1q_s16(dst + x, vshlq_n_s16(FUNC(pel_load8)(src + x), 14 - BIT_DEPTH));
+        }
+    }
+    else if (!my)
+    {
+        FUNC(qpel_filter_row)(dst, src + y * srcstride, 1, qpel_filter_size8[mx - 1], width);
+    }
+    else if (!mx)
+    {
+        FUNC(qpel_filter_row)(dst, src + y * srcstride, srcstride, qpel_filter_size8[my - 1], width);
+    }
+    else
+    {
+        const int16_t *filter_h = qpel_filter_size8[mx - 1];
+        const int16_t *filter_v = qpel_filter_size8[my - 1];
+        int16_t *rows[QPEL_RING_ROWS];
+        int ring_stride = RING_STRIDE(width);
+        int16x4_t filt[QPEL_RING_ROWS];
+
+        src -= QPEL_EXTRA_BEFORE * srcstride;
+        if (!y)
+        {
+            for (k = 0; k < QPEL_EXTRA; k++)
+            {
+                FUNC(qpel_filter_row)(RING_ROW(ring, QPEL_RING_ROWS, k), src + k * srcstride, 1, filter_h, width);
+            }
+        }
+        FUNC(qpel_filter_row)(RING_ROW(ring, QPEL_RING_ROWS, y + QPEL_EXTRA), src + (y + QPEL_EXTRA) * srcstride,
+                              1, filter_h, width);
+
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(ring, QPEL_RING_ROWS, y + k);
+            filt[k] = vdup_n_s16(filter_v[k]);
+        }
+        for (x = 0; x < width; x += 8)
+        {
+            int32x4x2_t final = FUNC(qpel_hv_filter_col)(rows, x, filt);
+
+            vst1_s16(dst + x, vqmovn_s32(vshrq_n_s32(final.val[0], 6)));
+            vst1_s16(dst + x + 4, vqmovn_s32(vshrq_n_s32(final.val[1], 6)));
+        }
+    }
+}
+
+static void FUNC(put_hevc_qpel_bipred)(uint8_t *_dst, ptrdiff_t _dststride,
+                                       uint8_t *_src0, ptrdiff_t _srcstride0,
+                                       uint8_t *_src1, ptrdiff_t _srcstride1,
+                                       int height, intptr_t mx0, intptr_t my0,
+                                       intptr_t mx1, intptr_t my1, int width)
+{
+    int x, y;
+    pixel *src0 = (pixel *)_src0;
+    ptrdiff_t srcstride0 = _srcstride0 / sizeof(pixel);
+    pixel *src1 = (pixel *)_src1;
+    ptrdiff_t srcstride1 = _srcstride1 / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    int16_t ring0[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t ring1[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t pred0[MAX_PB_SIZE];
+    int16_t pred1[MAX_PB_SIZE];
+
+    int shift = 14 + 1 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    int32x4_t offvector = vdupq_n_s32(offset);
+    int32x4_t max = vdupq_n_s32((1 << BIT_DEPTH) - 1);
+    int32x4_t min = vdupq_n_s32(0);
+
+    for (y = 0; y < height; y++)
+    {
+        FUNC(qpel_bipred_row)(pred0, src0, srcstride0, ring0, y, mx0, my0, width);
+        FUNC(qpel_bipred_row)(pred1, src1, srcstride1, ring1, y, mx1, my1, width);
+
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            int16x8_t p0 = vld1q_s16(pred0 + x);
+            int16x8_t p1 = vld1q_s16(pred1 + x);
+
+            int32x4_t sum0 = vaddq_s32(vaddl_s16(vget_low_s16(p0), vget_low_s16(p1)), offvector);
+            int32x4_t sum1 = vaddq_s32(vaddl_s16(vget_high_s16(p0), vget_high_s16(p1)), offvector);
+
+            sum0 = vshrq_n_s32(sum0, shift);
+            sum1 = vshrq_n_s32(sum1, shift);
+
+            uint16x4_t clip0 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, sum0))));
+            uint16x4_t clip1 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, sum1))));
+
+            FUNC(store_pixels8)(dst + x, vcombine_u16(clip0, clip1));
+        }
+        for (; x < width; x++)
+        {
+            dst[x] = uhd_clip_pixel((pred0[x] + pred1[x] + offset) >> shift);
+        }
+        dst += dststride;
+    }
+}
+// END OF QPEL_BIPRED
+
+static uhd_always_inline void FUNC(put_hevc_qpel_uni_w_h_store)(uint8_t *_dst, ptrdiff_t _dststride,
+                                                                uint8_t *_src, ptrdiff_t _srcstride,
+                                                                int height, int denom, int wx, int ox,
+                                                                intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_uni_w_h, mx, (_dst, _dststride, _src, _srcstride, height, denom, wx, ox, mx, my, width, nt));
+}
+
+PUT_NT_UNI_W(put_hevc_qpel_uni_w_h)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_bi_w_h_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                               ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                               int denom, int wx0, int wx1, int ox0, int ox1,
+                                                               intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_bi_w_h, mx, (_dst, _dststride, _src, _srcstride, src2, height, denom, wx0, wx1, ox0, ox1, mx, my, width, nt));
+}
+
+PUT_NT_BI_W(put_hevc_qpel_bi_w_h)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_uni_w_v_store)(uint8_t *_dst, ptrdiff_t _dststride,
+                                                                uint8_t *_src, ptrdiff_t _srcstride,
+                                                                int height, int denom, int wx, int ox,
+                                                                intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_uni_w_v, my, (_dst, _dststride, _src, _srcstride, height, denom, wx, ox, mx, my, width, nt));
+}
+
+PUT_NT_UNI_W(put_hevc_qpel_uni_w_v)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_bi_w_v_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                               ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                               int denom, int wx0, int wx1, int ox0, int ox1,
+                                                               intptr_t mx, intptr_t my, int width, int nt)
+{
+    QPEL_FRAC_DISPATCH(put_hevc_qpel_bi_w_v, my, (_dst, _dststride, _src, _srcstride, src2, height, denom, wx0, wx1, ox0, ox1, mx, my, width, nt));
+}
+
+PUT_NT_BI_W(put_hevc_qpel_bi_w_v)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_uni_w_hv_store)(uint8_t *_dst, ptrdiff_t _dststride,
+                                                                 uint8_t *_src, ptrdiff_t _srcstride,
+                                                                 int height, int denom, int wx, int ox,
+                                                                 intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y, k;
+    const int8_t *filter_h = uhd_hevc_qpel_filters[mx - 1];
+    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    int16_t tmp_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[QPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
+    int shift = denom + 14 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    src -= QPEL_EXTRA_BEFORE * srcstride;
+    for (y = 0; y < QPEL_EXTRA; y++)
+    {
+        FUNC(qpel_hv_filter_row_c)(RING_ROW(tmp_array, QPEL_RING_ROWS, y), src, filter_h, width);
+        src += srcstride;
+    }
+
+    ox = ox * (1 << (BIT_DEPTH - 8));
+    for (y = 0; y < height; y++)
+    {
+        FUNC(qpel_hv_filter_row_c)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA), src, filter_h, width);
+        src += srcstride;
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, QPEL_RING_ROWS, y + k);
+        }
+
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel((((QPEL_FILTER_ROWS(rows) >> 6) * wx + offset) >> shift) + ox));
+        dst += dststride;
+    }
+}
+
+PUT_NT_UNI_W(put_hevc_qpel_uni_w_hv)
+
+static uhd_always_inline void FUNC(put_hevc_qpel_bi_w_hv_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                                int denom, int wx0, int wx1, int ox0, int ox1,
+                                                                intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y, k;
+    const int8_t *filter_h = uhd_hevc_qpel_filters[mx - 1];
+    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    int16_t tmp_array[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[QPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
+    int shift = 14 + 1 - BIT_DEPTH;
+    int log2Wd = denom + shift - 1;
+
+    src -= QPEL_EXTRA_BEFORE * srcstride;
+    for (y = 0; y < QPEL_EXTRA; y++)
+    {
+        FUNC(qpel_hv_filter_row_c)(RING_ROW(tmp_array, QPEL_RING_ROWS, y), src, filter_h, width);
+        src += srcstride;
+    }
+
+    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
+    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
+    for (y = 0; y < height; y++)
+    {
+        FUNC(qpel_hv_filter_row_c)(RING_ROW(tmp_array, QPEL_RING_ROWS, y + QPEL_EXTRA), src, filter_h, width);
+        src += srcstride;
+        for (k = 0; k < QPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, QPEL_RING_ROWS, y + k);
+        }
+
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((QPEL_FILTER_ROWS(rows) >> 6) * wx1 + src2[x] * wx0 +
+                                                       ((ox0 + ox1 + 1) << log2Wd)) >>
+                                                      (log2Wd + 1)));
+        dst += dststride;
+        src2 += MAX_PB_SIZE;
+    }
+}
+
+PUT_NT_BI_W(put_hevc_qpel_bi_w_hv)
+
+////////////////////////////////////////////////////////////////////////////////
+//
+////////////////////////////////////////////////////////////////////////////////
+#define EPEL_FILTER(src, stride)   \
+    (filter[0] * src[x - stride] + \
+     filter[1] * src[x] +          \
+     filter[2] * src[x + stride] + \
+     filter[3] * src[x + 2 * stride])
+
+#define EPEL_FILTER_ROWS(rows) \
+    (filter[0] * rows[0][x] +  \
+     filter[1] * rows[1][x] +  \
+     filter[2] * rows[2][x] +  \
+     filter[3] * rows[3][x])
+
+static uhd_always_inline void FUNC(epel_hv_filter_row_c)(int16_t *tmp, pixel *src,
+                                                         const int8_t *filter, int width)
+{
+    int x;
+
+    for (x = 0; x < width; x++)
+    {
+        tmp[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+    }
+}
+
+static void FUNC(put_hevc_epel_h)(int16_t *dst,
+                                  uint8_t *_src, ptrdiff_t _srcstride,
+                                  int height, intptr_t mx, intptr_t my, int width)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
+
+    if (uhd_use_packed(width, height))
+    {
+        int16x8_t fil[4];
+
+        uhd_packed_epel_taps(fil, mx);
+        FUNC(put_hevc_packed)(dst, src, srcstride, 1, fil, 4, height, width);
+        return;
+    }
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            dst[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+        }
+        src += srcstride;
+        dst += MAX_PB_SIZE;
+    }
+}
+
+static void FUNC(put_hevc_epel_v)(int16_t *dst,
+                                  uint8_t *_src, ptrdiff_t _srcstride,
+                                  int height, intptr_t mx, intptr_t my, int width)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+
+    if (uhd_use_packed(width, height))
+    {
+        int16x8_t fil[4];
+
+        uhd_packed_epel_taps(fil, my);
+        FUNC(put_hevc_packed)(dst, src, srcstride, srcstride, fil, 4, height, width);
+        return;
+    }
+
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            dst[x] = EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8);
+        }
+        src += srcstride;
+        dst += MAX_PB_SIZE;
+    }
+}
+
+static void FUNC(put_hevc_epel_hv)(int16_t *dst,
+                                   uint8_t *_src, ptrdiff_t _srcstride,
+                                   int height, intptr_t mx, intptr_t my, int width)
+{
+    int x, y, k;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    const int8_t *filter_h = uhd_hevc_epel_filters[mx - 1];
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    int16_t tmp_array[EPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[EPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
+
+    if (uhd_use_packed(width, height))
+    {
+        int16x8_t fil_h[4], fil_v[4];
+
+        uhd_packed_epel_taps(fil_h, mx);
+        uhd_packed_epel_taps(fil_v, my);
+        FUNC(put_hevc_hv_packed)(dst, src, srcstride, fil_h, fil_v, 4, height, width);
+        return;
+    }
+
+    src -= EPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < EPEL_EXTRA; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y), src, filter_h, width);
+        src += srcstride;
+    }
+
+    for (y = 0; y < height; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y + EPEL_EXTRA), src, filter_h, width);
+        src += srcstride;
+        for (k = 0; k < EPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, EPEL_RING_ROWS, y + k);
+        }
+
+        for (x = 0; x < width; x++)
+        {
+            dst[x] = EPEL_FILTER_ROWS(rows) >> 6;
+        }
+        dst += MAX_PB_SIZE;
+    }
+}
+
+static uhd_always_inline void FUNC(put_hevc_epel_uni_h_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                              ptrdiff_t _srcstride, int height, intptr_t mx,
+                                                              intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
+    int shift = 14 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) + offset) >> shift));
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+PUT_NT_UNI(put_hevc_epel_uni_h)
+
+static uhd_always_inline void FUNC(put_hevc_epel_bi_h_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                             ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                             intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
+    int shift = 14 + 1 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) + src2[x] + offset) >> shift));
+        dst += dststride;
+        src += srcstride;
+        src2 += MAX_PB_SIZE;
+    }
+}
+
+PUT_NT_BI(put_hevc_epel_bi_h)
+
+static uhd_always_inline void FUNC(put_hevc_epel_uni_v_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                              ptrdiff_t _srcstride, int height, intptr_t mx,
+                                                              intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    int shift = 14 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) + offset) >> shift));
+        src += srcstride;
+        dst += dststride;
+    }
+}
+
+PUT_NT_UNI(put_hevc_epel_uni_v)
+
+static uhd_always_inline void FUNC(put_hevc_epel_bi_v_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                             ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                             intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    int shift = 14 + 1 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    for (y = 0; y < height; y++)
+    {
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) + src2[x] + offset) >> shift));
+        dst += dststride;
+        src += srcstride;
+        src2 += MAX_PB_SIZE;
+    }
+}
+
+PUT_NT_BI(put_hevc_epel_bi_v)
+
+static uhd_always_inline void FUNC(put_hevc_epel_uni_hv_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                               ptrdiff_t _srcstride, int height, intptr_t mx,
+                                                               intptr_t my, int width, int nt)
+{
+    int x, y, k;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter_h = uhd_hevc_epel_filters[mx - 1];
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    int16_t tmp_array[EPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[EPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
+    int shift = 14 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    src -= EPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < EPEL_EXTRA; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y), src, filter_h, width);
+        src += srcstride;
+    }
+
+    for (y = 0; y < height; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y + EPEL_EXTRA), src, filter_h, width);
+        src += srcstride;
+        for (k = 0; k < EPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, EPEL_RING_ROWS, y + k);
+        }
+
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER_ROWS(rows) >> 6) + offset) >> shift));
+        dst += dststride;
+    }
+}
+
+PUT_NT_UNI(put_hevc_epel_uni_hv)
+
+static uhd_always_inline void FUNC(put_hevc_epel_bi_hv_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                              ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                              intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y, k;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter_h = uhd_hevc_epel_filters[mx - 1];
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    int16_t tmp_array[EPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[EPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
+    int shift = 14 + 1 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    src -= EPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < EPEL_EXTRA; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y), src, filter_h, width);
+        src += srcstride;
+    }
+
+    for (y = 0; y < height; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y + EPEL_EXTRA), src, filter_h, width);
+        src += srcstride;
+        for (k = 0; k < EPEL_RING_ROWS; k++)
+        {
+            rows[k] = RING_ROW(tmp_array, EPEL_RING_ROWS, y + k);
+        }
+
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER_ROWS(rows) >> 6) + src2[x] + offset) >> shift));
+        dst += dststride;
+        src2 += MAX_PB_SIZE;
+    }
+    // exit(0);
+}
+
+PUT_NT_BI(put_hevc_epel_bi_hv)
+
+static uhd_always_inline void FUNC(put_hevc_epel_uni_w_h_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                ptrdiff_t _srcstride, int height, int denom, int wx,
+                                                                int ox, intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
+    int shift = denom + 14 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
+
+    ox = ox * (1 << (BIT_DEPTH - 8));
+    for (y = 0; y < height; y++)
+    {
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel((((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) * wx + offset) >> shift) + ox));
+        dst += dststride;
+        src += srcstride;
+    }
+}
+
+PUT_NT_UNI_W(put_hevc_epel_uni_w_h)
+
+static uhd_always_inline void FUNC(put_hevc_epel_bi_w_h_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                               ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                               int denom, int wx0, int wx1, int ox0, int ox1,
+                                                               intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    pixel *dst = (pixel *)_dst;
+    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
+    int shift = 14 + 1 - BIT_DEPTH;
+    int log2Wd = denom + shift - 1;
+
+    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
+    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
+    for (y = 0; y < height; y++)
+    {
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) * wx1 + src2[x] * wx0 +
+                                                       ((ox0 + ox1 + 1) << log2Wd)) >>
+                                                      (log2Wd + 1)));
+        src += srcstride;
+        dst += dststride;
+        src2 += MAX_PB_SIZE;
+    }
+}
+
+PUT_NT_BI_W(put_hevc_epel_bi_w_h)
+
+static uhd_always_inline void FUNC(put_hevc_epel_uni_w_v_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                ptrdiff_t _srcstride, int height, int denom, int wx,
+                                                                int ox, intptr_t mx, intptr_t my, int width, int nt)
+{
+    int x, y;
     pixel *src = (pixel *)_src;
     ptrdiff_t srcstride = _srcstride / sizeof(pixel);
     pixel *dst = (pixel *)_dst;
     ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    int shift = denom + 14 - BIT_DEPTH;
+#if BIT_DEPTH < 14
+    int offset = 1 << (shift - 1);
+#else
+    int offset = 0;
+#endif
 
+    ox = ox * (1 << (BIT_DEPTH - 8));
     for (y = 0; y < height; y++)
     {
-        memcpy(dst, src, width * sizeof(pixel));
-        src += srcstride;
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel((((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) * wx + offset) >> shift) + ox));
         dst += dststride;
+        src += srcstride;
     }
 }
 
-static void FUNC(put_hevc_pel_bi_pixels)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                         int16_t *src2,
-                                         int height, intptr_t mx, intptr_t my, int width)
+PUT_NT_UNI_W(put_hevc_epel_uni_w_v)
+
+static uhd_always_inline void FUNC(put_hevc_epel_bi_w_v_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                               ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                               int denom, int wx0, int wx1, int ox0, int ox1,
+                                                               intptr_t mx, intptr_t my, int width, int nt)
 {
     int x, y;
     pixel *src = (pixel *)_src;
     ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
     pixel *dst = (pixel *)_dst;
     ptrdiff_t dststride = _dststride / sizeof(pixel);
-
     int shift = 14 + 1 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    int log2Wd = denom + shift - 1;
 
+    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
+    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
     for (y = 0; y < height; y++)
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = uhd_clip_pixel(((src[x] << (14 - BIT_DEPTH)) + src2[x] + offset) >> shift);
-        }
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) * wx1 + src2[x] * wx0 +
+                                                       ((ox0 + ox1 + 1) << log2Wd)) >>
+                                                      (log2Wd + 1)));
         src += srcstride;
         dst += dststride;
         src2 += MAX_PB_SIZE;
     }
 }
 
-static void FUNC(put_hevc_pel_uni_w_pixels)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                            int height, int denom, int wx, int ox, intptr_t mx, intptr_t my, int width)
+PUT_NT_BI_W(put_hevc_epel_bi_w_v)
+
+static uhd_always_inline void FUNC(put_hevc_epel_uni_w_hv_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                 ptrdiff_t _srcstride, int height, int denom, int wx,
+                                                                 int ox, intptr_t mx, intptr_t my, int width, int nt)
 {
-    int x, y;
+    int x, y, k;
     pixel *src = (pixel *)_src;
     ptrdiff_t srcstride = _srcstride / sizeof(pixel);
     pixel *dst = (pixel *)_dst;
     ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const int8_t *filter_h = uhd_hevc_epel_filters[mx - 1];
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    int16_t tmp_array[EPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[EPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
     int shift = denom + 14 - BIT_DEPTH;
 #if BIT_DEPTH < 14
     int offset = 1 << (shift - 1);
@@ -806,1762 +3876,3227 @@ static void FUNC(put_hevc_pel_uni_w_pixels)(uint8_t *_dst, ptrdiff_t _dststride,
     int offset = 0;
 #endif
 
+    src -= EPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < EPEL_EXTRA; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y), src, filter_h, width);
+        src += srcstride;
+    }
+
     ox = ox * (1 << (BIT_DEPTH - 8));
     for (y = 0; y < height; y++)
     {
-        for (x = 0; x < width; x++)
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y + EPEL_EXTRA), src, filter_h, width);
+        src += srcstride;
+        for (k = 0; k < EPEL_RING_ROWS; k++)
         {
-            dst[x] = uhd_clip_pixel((((src[x] << (14 - BIT_DEPTH)) * wx + offset) >> shift) + ox);
+            rows[k] = RING_ROW(tmp_array, EPEL_RING_ROWS, y + k);
         }
-        src += srcstride;
+
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel((((EPEL_FILTER_ROWS(rows) >> 6) * wx + offset) >> shift) + ox));
         dst += dststride;
     }
 }
 
-static void FUNC(put_hevc_pel_bi_w_pixels)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                           int16_t *src2,
-                                           int height, int denom, int wx0, int wx1,
-                                           int ox0, int ox1, intptr_t mx, intptr_t my, int width)
+PUT_NT_UNI_W(put_hevc_epel_uni_w_hv)
+
+static uhd_always_inline void FUNC(put_hevc_epel_bi_w_hv_store)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src,
+                                                                ptrdiff_t _srcstride, int16_t *src2, int height,
+                                                                int denom, int wx0, int wx1, int ox0, int ox1,
+                                                                intptr_t mx, intptr_t my, int width, int nt)
 {
-    int x, y;
+    int x, y, k;
     pixel *src = (pixel *)_src;
     ptrdiff_t srcstride = _srcstride / sizeof(pixel);
     pixel *dst = (pixel *)_dst;
     ptrdiff_t dststride = _dststride / sizeof(pixel);
-
+    const int8_t *filter_h = uhd_hevc_epel_filters[mx - 1];
+    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    int16_t tmp_array[EPEL_RING_ROWS * MAX_PB_SIZE];
+    int16_t *rows[EPEL_RING_ROWS];
+    int ring_stride = RING_STRIDE(width);
     int shift = 14 + 1 - BIT_DEPTH;
     int log2Wd = denom + shift - 1;
 
+    src -= EPEL_EXTRA_BEFORE * srcstride;
+
+    for (y = 0; y < EPEL_EXTRA; y++)
+    {
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y), src, filter_h, width);
+        src += srcstride;
+    }
+
     ox0 = ox0 * (1 << (BIT_DEPTH - 8));
     ox1 = ox1 * (1 << (BIT_DEPTH - 8));
     for (y = 0; y < height; y++)
     {
-        for (x = 0; x < width; x++)
+        FUNC(epel_hv_filter_row_c)(RING_ROW(tmp_array, EPEL_RING_ROWS, y + EPEL_EXTRA), src, filter_h, width);
+        src += srcstride;
+        for (k = 0; k < EPEL_RING_ROWS; k++)
         {
-            dst[x] = uhd_clip_pixel(((src[x] << (14 - BIT_DEPTH)) * wx1 + src2[x] * wx0 + ((ox0 + ox1 + 1) << log2Wd)) >>
-                                    (log2Wd + 1));
+            rows[k] = RING_ROW(tmp_array, EPEL_RING_ROWS, y + k);
         }
-        src += srcstride;
+
+        UHD_PUT_ROW(dst, width, nt, x, uhd_clip_pixel(((EPEL_FILTER_ROWS(rows) >> 6) * wx1 + src2[x] * wx0 +
+                                                       ((ox0 + ox1 + 1) << log2Wd)) >>
+                                                      (log2Wd + 1)));
         dst += dststride;
         src2 += MAX_PB_SIZE;
     }
-}
+} // line zero
+
+PUT_NT_BI_W(put_hevc_epel_bi_w_hv)
+
+#undef PUT_NT_UNI
+#undef PUT_NT_BI
+#undef PUT_NT_UNI_W
+#undef PUT_NT_BI_W
 
 ////////////////////////////////////////////////////////////////////////////////
-//
+// Block-matching costs for the analysis and re-encode tools, on the pixel
+// layout and byte strides of the MC kernels. Width and height are multiples
+// of 4 from 4 to 64. The sad_x3 / sad_x4 forms score one source block against
+// several candidates in a single pass over it. SATD is the HM cost: the sum
+// of the absolute 4x4 Hadamard coefficients, halved with rounding per 4x4
+// block. The _c versions are the scalar references for the conformance
+// checker.
 ////////////////////////////////////////////////////////////////////////////////
-#define QPEL_FILTER(src, stride)       \
-    (filter[0] * src[x - 3 * stride] + \
-     filter[1] * src[x - 2 * stride] + \
-     filter[2] * src[x - stride] +     \
-     filter[3] * src[x] +              \
-     filter[4] * src[x + stride] +     \
-     filter[5] * src[x + 2 * stride] + \
-     filter[6] * src[x + 3 * stride] + \
-     filter[7] * src[x + 4 * stride])
-
-static void FUNC(put_hevc_qpel_h)(int16_t *dst,
-                                  uint8_t *_src, ptrdiff_t _srcstride,
-                                  int height, intptr_t mx, intptr_t my, int width)
+static int FUNC(pixel_sad_c)(const uint8_t *_src, ptrdiff_t srcstride, const uint8_t *_ref, ptrdiff_t refstride,
+                             int width, int height)
 {
+    const pixel *src = (const pixel *)_src;
+    const pixel *ref = (const pixel *)_ref;
     int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_qpel_filters[mx - 1];
+    int sum = 0;
+
+    srcstride /= sizeof(pixel);
+    refstride /= sizeof(pixel);
     for (y = 0; y < height; y++)
     {
         for (x = 0; x < width; x++)
         {
-            dst[x] = QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            sum += UHDABS(src[x] - ref[x]);
         }
         src += srcstride;
-        dst += MAX_PB_SIZE;
+        ref += refstride;
     }
+    return sum;
 }
 
-static void FUNC(put_hevc_qpel_v)(int16_t *dst,
-                                  uint8_t *_src, ptrdiff_t _srcstride,
-                                  int height, intptr_t mx, intptr_t my, int width)
+static uint64_t FUNC(pixel_sse_c)(const uint8_t *_src, ptrdiff_t srcstride, const uint8_t *_ref,
+                                  ptrdiff_t refstride, int width, int height)
 {
+    const pixel *src = (const pixel *)_src;
+    const pixel *ref = (const pixel *)_ref;
     int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
+    uint64_t sum = 0;
+
+    srcstride /= sizeof(pixel);
+    refstride /= sizeof(pixel);
     for (y = 0; y < height; y++)
     {
         for (x = 0; x < width; x++)
         {
-            dst[x] = QPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8);
+            sum += (src[x] - ref[x]) * (src[x] - ref[x]);
         }
         src += srcstride;
-        dst += MAX_PB_SIZE;
+        ref += refstride;
     }
+    return sum;
 }
 
-// START OF THE FUNCTION  -> QPEL_HV
-#define VECTOR_LOGIC2_LOOP1
-#define VECTOR_LOGIC2_LOOP2
-
-static void FUNC(put_hevc_qpel_hv)(int16_t *dst,
-                                   uint8_t *_src,
-                                   ptrdiff_t _srcstride,
-                                   int height, intptr_t mx,
-                                   intptr_t my, int width)
+static int FUNC(pixel_satd_c)(const uint8_t *_src, ptrdiff_t srcstride, const uint8_t *_ref, ptrdiff_t refstride,
+                              int width, int height)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    int16_t tmp_array[(MAX_PB_SIZE + QPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    src -= QPEL_EXTRA_BEFORE * srcstride;
-    const int16_t *filter;
-    filter = qpel_filter_size8[mx - 1];
-
-#ifdef SCALAR_LOOP1
-    for (y = 0; y < height + QPEL_EXTRA; y++)
+    const pixel *src = (const pixel *)_src;
+    const pixel *ref = (const pixel *)_ref;
+    int x, y, i;
+    int sum = 0;
+
+    srcstride /= sizeof(pixel);
+    refstride /= sizeof(pixel);
+    for (y = 0; y < height; y += 4)
     {
-        for (x = 0; x < width; x++)
+        for (x = 0; x < width; x += 4)
         {
-            tmp[x] = QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            int m[4][4];
+            int satd = 0;
+
+            for (i = 0; i < 4; i++)
+            {
+                const pixel *s = src + (y + i) * srcstride + x;
+                const pixel *r = ref + (y + i) * refstride + x;
+                int a0 = (s[0] - r[0]) + (s[1] - r[1]);
+                int a1 = (s[0] - r[0]) - (s[1] - r[1]);
+                int a2 = (s[2] - r[2]) + (s[3] - r[3]);
+                int a3 = (s[2] - r[2]) - (s[3] - r[3]);
+
+                m[i][0] = a0 + a2;
+                m[i][1] = a1 + a3;
+                m[i][2] = a0 - a2;
+                m[i][3] = a1 - a3;
+            }
+            for (i = 0; i < 4; i++)
+            {
+                int a0 = m[0][i] + m[1][i];
+                int a1 = m[0][i] - m[1][i];
+                int a2 = m[2][i] + m[3][i];
+                int a3 = m[2][i] - m[3][i];
+
+                satd += UHDABS(a0 + a2) + UHDABS(a1 + a3) + UHDABS(a0 - a2) + UHDABS(a1 - a3);
+            }
+            sum += (satd + 1) >> 1;
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
     }
-#endif
-
-#ifdef VECTOR_LOGIC2_LOOP1
-    int shift = BIT_DEPTH - 8;
-    int yval = height + QPEL_EXTRA;
-    filter = qpel_filter_size8[mx - 1];
-
-    #if BIT_DEPTH > 8
-            int16x4_t fil0 = vdup_n_s16(filter[0]);
-            int16x4_t fil1 = vdup_n_s16(filter[1]);
-            int16x4_t fil2 = vdup_n_s16(filter[2]);
-            int16x4_t fil3 = vdup_n_s16(filter[3]);
-            int16x4_t fil4 = vdup_n_s16(filter[4]);
-            int16x4_t fil5 = vdup_n_s16(filter[5]);
-            int16x4_t fil6 = vdup_n_s16(filter[6]);
-            int16x4_t fil7 = vdup_n_s16(filter[7]);
-    #else
-            int16x8_t fil0 = vdupq_n_s16(filter[0]);
-            int16x8_t fil1 = vdupq_n_s16(filter[1]);
-            int16x8_t fil2 = vdupq_n_s16(filter[2]);
-            int16x8_t fil3 = vdupq_n_s16(filter[3]);
-            int16x8_t fil4 = vdupq_n_s16(filter[4]);
-            int16x8_t fil5 = vdupq_n_s16(filter[5]);
-            int16x8_t fil6 = vdupq_n_s16(filter[6]);
-            int16x8_t fil7 = vdupq_n_s16(filter[7]);
-    #endif
-
-    for (y = 0; y < yval; y++)
-    {
-        for (x = 0; x < width; x += 8)
-        {
-        #if BIT_DEPTH > 8
-            int32x4_t final1 = vdupq_n_s32(0);
-            int32x4_t final2 = vdupq_n_s32(0);
+    return sum;
+}
 
-            uint16_t *ptr;
-            ptr = src + x;
-              int16x4_t src0 = vreinterpret_s16_u16(vld1_u16(ptr - 3));
-            int16x4_t src1 = vreinterpret_s16_u16(vld1_u16(ptr + 1));
+static void FUNC(pixel_sad_x3_c)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *const *ref,
+                                 ptrdiff_t refstride, int width, int height, int *cost)
+{
+    int i;
 
-            int16x4_t src2 = vreinterpret_s16_u16(vld1_u16(ptr - 2));
-            int16x4_t src3 = vreinterpret_s16_u16(vld1_u16(ptr + 2));
+    for (i = 0; i < 3; i++)
+    {
+        cost[i] = FUNC(pixel_sad_c)(src, srcstride, ref[i], refstride, width, height);
+    }
+}
 
-            int16x4_t src4 = vreinterpret_s16_u16(vld1_u16(ptr - 1));
-            int16x4_t src5 = vreinterpret_s16_u16(vld1_u16(ptr + 3));
+static void FUNC(pixel_sad_x4_c)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *const *ref,
+                                 ptrdiff_t refstride, int width, int height, int *cost)
+{
+    int i;
 
-            int16x4_t src6 = vreinterpret_s16_u16(vld1_u16(ptr));
-            int16x4_t src7 = vreinterpret_s16_u16(vld1_u16(ptr + 4));
+    for (i = 0; i < 4; i++)
+    {
+        cost[i] = FUNC(pixel_sad_c)(src, srcstride, ref[i], refstride, width, height);
+    }
+}
 
-            int16x4_t src8 = vreinterpret_s16_u16(vld1_u16(ptr + 1));
-            int16x4_t src9 = vreinterpret_s16_u16(vld1_u16(ptr + 5));
+// four pixels from each of two rows, widened to 16-bit lanes
+static uhd_always_inline uint16x8_t FUNC(cost_load4x2)(const pixel *row0, const pixel *row1)
+{
+#if BIT_DEPTH > 8
+    return vcombine_u16(vld1_u16(row0), vld1_u16(row1));
+#else
+    uint8_t buf[8];
 
-            int16x4_t src10 = vreinterpret_s16_u16(vld1_u16(ptr + 2));
-            int16x4_t src11 = vreinterpret_s16_u16(vld1_u16(ptr + 6));
+    memcpy(buf, row0, 4);
+    memcpy(buf + 4, row1, 4);
+    return vmovl_u8(vld1_u8(buf));
+#endif
+}
 
-            int16x4_t src12 = vreinterpret_s16_u16(vld1_u16(ptr + 3));
-            int16x4_t src13 = vreinterpret_s16_u16(vld1_u16(ptr + 7));
+// Rows are taken in pairs so that the 4-column remainder of a 4-, 12-, 24-
+// or 48-wide block still fills a vector.
+static uhd_always_inline void FUNC(pixel_sad_xn)(const uint8_t *_src, ptrdiff_t srcstride,
+                                                 const uint8_t *const *_ref, ptrdiff_t refstride,
+                                                 int width, int height, int *cost, int n)
+{
+    const pixel *src = (const pixel *)_src;
+    uint32x4_t acc[4];
+    int x, y, k;
 
-            int16x4_t src14 = vreinterpret_s16_u16(vld1_u16(ptr + 4));
-            int16x4_t src15 = vreinterpret_s16_u16(vld1_u16(ptr + 8));
+    srcstride /= sizeof(pixel);
+    refstride /= sizeof(pixel);
+    for (k = 0; k < n; k++)
+    {
+        acc[k] = vdupq_n_u32(0);
+    }
+    for (y = 0; y < height; y += 2)
+    {
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            uint16x8_t s0 = FUNC(load_pixels8)(src + y * srcstride + x);
+            uint16x8_t s1 = FUNC(load_pixels8)(src + (y + 1) * srcstride + x);
 
-            final1 = vmlal_s16(final1, src0 , fil0);
-            final2 = vmlal_s16(final2, src1 , fil0);
+            for (k = 0; k < n; k++)
+            {
+                const pixel *ref = (const pixel *)_ref[k] + y * refstride + x;
 
-            final1 = vmlal_s16(final1, src2 , fil1);
-            final2 = vmlal_s16(final2, src3 , fil1);
+                acc[k] = vpadalq_u16(acc[k], vabdq_u16(s0, FUNC(load_pixels8)(ref)));
+                acc[k] = vpadalq_u16(acc[k], vabdq_u16(s1, FUNC(load_pixels8)(ref + refstride)));
+            }
+        }
+        if (x < width)
+        {
+            uint16x8_t s = FUNC(cost_load4x2)(src + y * srcstride + x, src + (y + 1) * srcstride + x);
 
-            final1 = vmlal_s16(final1, src4 , fil2);
-            final2 = vmlal_s16(final2, src5 , fil2);
+            for (k = 0; k < n; k++)
+            {
+                const pixel *ref = (const pixel *)_ref[k] + y * refstride + x;
 
-            final1 = vmlal_s16(final1, src6 , fil3);
-            final2 = vmlal_s16(final2, src7 , fil3);
+                acc[k] = vpadalq_u16(acc[k], vabdq_u16(s, FUNC(cost_load4x2)(ref, ref + refstride)));
+            }
+        }
+    }
+    for (k = 0; k < n; k++)
+    {
+        cost[k] = vaddvq_u32(acc[k]);
+    }
+}
 
-            final1 = vmlal_s16(final1, src8 , fil4);
-            final2 = vmlal_s16(final2, src9 , fil4);
+static int FUNC(pixel_sad)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *ref, ptrdiff_t refstride,
+                           int width, int height)
+{
+    int cost;
 
-            final1 = vmlal_s16(final1, src10 , fil5);
-            final2 = vmlal_s16(final2, src11 , fil5);
+    FUNC(pixel_sad_xn)(src, srcstride, &ref, refstride, width, height, &cost, 1);
+    return cost;
+}
 
-            final1 = vmlal_s16(final1, src12 , fil6);
-            final2 = vmlal_s16(final2, src13 , fil6);
+static void FUNC(pixel_sad_x3)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *const *ref,
+                               ptrdiff_t refstride, int width, int height, int *cost)
+{
+    FUNC(pixel_sad_xn)(src, srcstride, ref, refstride, width, height, cost, 3);
+}
 
-            final1 = vmlal_s16(final1, src14 , fil7);
-            final2 = vmlal_s16(final2, src15 , fil7);
+static void FUNC(pixel_sad_x4)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *const *ref,
+                               ptrdiff_t refstride, int width, int height, int *cost)
+{
+    FUNC(pixel_sad_xn)(src, srcstride, ref, refstride, width, height, cost, 4);
+}
 
-            final1 = vshrq_n_s32(final1, shift);
-            final2 = vshrq_n_s32(final2, shift);
+static uhd_always_inline uint32x4_t FUNC(sse_acc)(uint32x4_t acc, uint16x8_t a, uint16x8_t b)
+{
+    uint16x8_t d = vabdq_u16(a, b);
 
-            int16x4_t intt1 = vmovn_s32(final1);
-            int16x4_t intt2 = vmovn_s32(final2);
+    acc = vmlal_u16(acc, vget_low_u16(d), vget_low_u16(d));
+    return vmlal_high_u16(acc, d, d);
+}
 
-            vst1_s16(tmp + x, intt1);
-            vst1_s16(tmp + x + 4, intt2);
+// The squares are summed in 32-bit lanes for one row pair at a time (at most
+// 32 squares per lane) and then widened, which stays exact up to 12 bits.
+static uint64_t FUNC(pixel_sse)(const uint8_t *_src, ptrdiff_t srcstride, const uint8_t *_ref, ptrdiff_t refstride,
+                                int width, int height)
+{
+    const pixel *src = (const pixel *)_src;
+    const pixel *ref = (const pixel *)_ref;
+    uint64x2_t sum = vdupq_n_u64(0);
+    int x, y;
 
-        #else
-            int16x8_t final = vdupq_n_s16(0);
-            uint8_t *ptr;
-            ptr = src + x;
-            int16x8_t src0 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 3)));
-            int16x8_t src1 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 2)));
-            int16x8_t src2 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 1)));
-            int16x8_t src3 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr)));
-            int16x8_t src4 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 1)));
-            int16x8_t src5 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 2)));
-            int16x8_t src6 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 3)));
-            int16x8_t src7 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 4)));
+    srcstride /= sizeof(pixel);
+    refstride /= sizeof(pixel);
+    for (y = 0; y < height; y += 2)
+    {
+        uint32x4_t acc = vdupq_n_u32(0);
 
-            final = vmlaq_s16(final, src0, fil0);
-            final = vmlaq_s16(final, src1, fil1);
-            final = vmlaq_s16(final, src2, fil2);
-            final = vmlaq_s16(final, src3, fil3);
-            final = vmlaq_s16(final, src4, fil4);
-            final = vmlaq_s16(final, src5, fil5);
-            final = vmlaq_s16(final, src6, fil6);
-            final = vmlaq_s16(final, src7, fil7);
-            final = vshrq_n_s16(final, shift);
-            vst1q_s16(tmp + x, final);
-    #endif
+        for (x = 0; x + 8 <= width; x += 8)
+        {
+            acc = FUNC(sse_acc)(acc, FUNC(load_pixels8)(src + x), FUNC(load_pixels8)(ref + x));
+            acc = FUNC(sse_acc)(acc, FUNC(load_pixels8)(src + srcstride + x),
+                                FUNC(load_pixels8)(ref + refstride + x));
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
+        if (x < width)
+        {
+            acc = FUNC(sse_acc)(acc, FUNC(cost_load4x2)(src + x, src + srcstride + x),
+                                FUNC(cost_load4x2)(ref + x, ref + refstride + x));
+        }
+        sum = vpadalq_u32(sum, acc);
+        src += 2 * srcstride;
+        ref += 2 * refstride;
     }
-#endif
+    return vaddvq_u64(sum);
+}
 
-#ifdef SCALAR_LOOP2
-    tmp = tmp_array + QPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = qpel_filter_size8[my - 1];
-    for (y = 0; y < height; y++)
+// Adds the absolute 4x4 Hadamard coefficients of the two 4x4 blocks held
+// side by side in d[0..3], one row per vector. Each half is transposed
+// between the vertical and horizontal passes. Up to 10 bits the
+// coefficients fit in int16.
+static uhd_always_inline uint32x4_t FUNC(satd_8x4)(uint32x4_t acc, const int16x8_t *d)
+{
+    int16x8_t s0 = vaddq_s16(d[0], d[1]);
+    int16x8_t s1 = vsubq_s16(d[0], d[1]);
+    int16x8_t s2 = vaddq_s16(d[2], d[3]);
+    int16x8_t s3 = vsubq_s16(d[2], d[3]);
+    int16x8x2_t t01 = vtrnq_s16(vaddq_s16(s0, s2), vaddq_s16(s1, s3));
+    int16x8x2_t t23 = vtrnq_s16(vsubq_s16(s0, s2), vsubq_s16(s1, s3));
+    int32x4x2_t c02 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[0]), vreinterpretq_s32_s16(t23.val[0]));
+    int32x4x2_t c13 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[1]), vreinterpretq_s32_s16(t23.val[1]));
+    int16x8_t c0 = vreinterpretq_s16_s32(c02.val[0]);
+    int16x8_t c1 = vreinterpretq_s16_s32(c13.val[0]);
+    int16x8_t c2 = vreinterpretq_s16_s32(c02.val[1]);
+    int16x8_t c3 = vreinterpretq_s16_s32(c13.val[1]);
+
+    s0 = vaddq_s16(c0, c1);
+    s1 = vsubq_s16(c0, c1);
+    s2 = vaddq_s16(c2, c3);
+    s3 = vsubq_s16(c2, c3);
+    acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(vaddq_s16(s0, s2))));
+    acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(vaddq_s16(s1, s3))));
+    acc = vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(vsubq_s16(s0, s2))));
+    return vpadalq_u16(acc, vreinterpretq_u16_s16(vabsq_s16(vsubq_s16(s1, s3))));
+}
+
+// Every coefficient of a 4x4 Hadamard block has the parity of the block's
+// sum, so each block total is even. Halving the grand total once therefore
+// matches the per-block rounding of pixel_satd_c.
+static int FUNC(pixel_satd)(const uint8_t *_src, ptrdiff_t srcstride, const uint8_t *_ref, ptrdiff_t refstride,
+                            int width, int height)
+{
+#if BIT_DEPTH > 10
+    return FUNC(pixel_satd_c)(_src, srcstride, _ref, refstride, width, height);
+#else
+    const pixel *src = (const pixel *)_src;
+    const pixel *ref = (const pixel *)_ref;
+    uint32x4_t acc = vdupq_n_u32(0);
+    int16x8_t d[4];
+    int x, y, k;
+
+    srcstride /= sizeof(pixel);
+    refstride /= sizeof(pixel);
+    for (y = 0; y < height; y += 4)
     {
-        for (x = 0; x < width; x++)
+        for (x = 0; x + 8 <= width; x += 8)
         {
-            dst[x] = QPEL_FILTER(tmp, MAX_PB_SIZE) >> 6;
+            for (k = 0; k < 4; k++)
+            {
+                d[k] = vreinterpretq_s16_u16(vsubq_u16(FUNC(load_pixels8)(src + (y + k) * srcstride + x),
+                                                       FUNC(load_pixels8)(ref + (y + k) * refstride + x)));
+            }
+            acc = FUNC(satd_8x4)(acc, d);
         }
-        tmp += MAX_PB_SIZE;
-        dst += MAX_PB_SIZE;
     }
-#endif
-
-#ifdef VECTOR_LOGIC2_LOOP2
-    int16_t *str;
-    tmp = tmp_array + QPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = qpel_filter_size8[my - 1];
-
-    int16x4_t filt0 = vdup_n_s16(filter[0]);
-    int16x4_t filt1 = vdup_n_s16(filter[1]);
-    int16x4_t filt2 = vdup_n_s16(filter[2]);
-    int16x4_t filt3 = vdup_n_s16(filter[3]);
-    int16x4_t filt4 = vdup_n_s16(filter[4]);
-    int16x4_t filt5 = vdup_n_s16(filter[5]);
-    int16x4_t filt6 = vdup_n_s16(filter[6]);
-    int16x4_t filt7 = vdup_n_s16(filter[7]);
 
-    for (y = 0; y < height; y++)
+    // a 4-column remainder pairs each 4-row stripe with the next one; an odd
+    // last stripe is paired with zeros
+    if (width & 4)
     {
-        for (x = 0; x < width; x += 8)
+        x = width - 4;
+        for (y = 0; y < height; y += 8)
         {
-            int32x4_t final1 = vdupq_n_s32(0);
-            int32x4_t final2 = vdupq_n_s32(0);
-
-            str = tmp + x;
-            int16x4_t src0 = vld1_s16(str - 192);
-            int16x4_t src1 = vld1_s16(str - 188);
-
-            int16x4_t src2 = vld1_s16(str - 128);
-            int16x4_t src3 = vld1_s16(str - 124);
-
-            int16x4_t src4 = vld1_s16(str - 64);
-            int16x4_t src5 = vld1_s16(str - 60);
+            int hi = y + 4 < height ? 4 : 0;
 
-            int16x4_t src6 = vld1_s16(str);
-            int16x4_t src7 = vld1_s16(str + 4);
-
-            int16x4_t src8 = vld1_s16(str + 64);
-            int16x4_t src9 = vld1_s16(str + 68);
-
-            int16x4_t src10 = vld1_s16(str + 128);
-            int16x4_t src11 = vld1_s16(str + 132);
-
-            int16x4_t src12 = vld1_s16(str + 192);
-            int16x4_t src13 = vld1_s16(str + 196);
-
-            int16x4_t src14 = vld1_s16(str + 256);
-            int16x4_t src15 = vld1_s16(str + 260);
-
-            final1 = vmlal_s16(final1, src0, filt0);
-            final2 = vmlal_s16(final2, src1, filt0);
-
-            final1 = vmlal_s16(final1, src2, filt1);
-            final2 = vmlal_s16(final2, src3, filt1);
-
-            final1 = vmlal_s16(final1, src4, filt2);
-            final2 = vmlal_s16(final2, src5, filt2);
+            for (k = 0; k < 4; k++)
+            {
+                const pixel *s = src + (y + k) * srcstride + x;
+                const pixel *r = ref + (y + k) * refstride + x;
 
-            final1 = vmlal_s16(final1, src6, filt3);
-            final2 = vmlal_s16(final2, src7, filt3);
+                d[k] = vreinterpretq_s16_u16(vsubq_u16(FUNC(cost_load4x2)(s, s + hi * srcstride),
+                                                       FUNC(cost_load4x2)(r, r + hi * refstride)));
+                if (!hi)
+                {
+                    d[k] = vcombine_s16(vget_low_s16(d[k]), vdup_n_s16(0));
+                }
+            }
+            acc = FUNC(satd_8x4)(acc, d);
+        }
+    }
+    return vaddvq_u32(acc) >> 1;
+#endif
+}
 
-            final1 = vmlal_s16(final1, src8, filt4);
-            final2 = vmlal_s16(final2, src9, filt4);
+////////////////////////////////////////////////////////////////////////////////
+// Intra prediction. pred_planar_N, pred_dc and pred_angular_N have the
+// signatures of the pred_planar[4], pred_dc and pred_angular[4] slots of the
+// prediction table, where N = log2_size - 2. top and left point at the
+// reference samples of the block. The corner is top[-1] == left[-1], and
+// 2 * size samples follow it on each side. intra_filter_ref smooths the
+// references first. Up to 10 bits every sum fits a uint16 lane; deeper
+// pixels take the scalar loops.
+////////////////////////////////////////////////////////////////////////////////
+#define VECTOR_INTRA
 
-            final1 = vmlal_s16(final1, src10, filt5);
-            final2 = vmlal_s16(final2, src11, filt5);
+#if defined(VECTOR_INTRA) && BIT_DEPTH <= 10
+#define INTRA_VECTOR 1
+#else
+#define INTRA_VECTOR 0
+#endif
 
-            final1 = vmlal_s16(final1, src12, filt6);
-            final2 = vmlal_s16(final2, src13, filt6);
+// stores the first n (4 or 8) lanes
+static uhd_always_inline void FUNC(intra_store)(pixel *dst, uint16x8_t v, int n)
+{
+    pixel tmp[8];
 
-            final1 = vmlal_s16(final1, src14, filt7);
-            final2 = vmlal_s16(final2, src15, filt7);
+    if (n == 8)
+    {
+        FUNC(store_pixels8)(dst, v);
+        return;
+    }
+    FUNC(store_pixels8)(tmp, v);
+    memcpy(dst, tmp, n * sizeof(pixel));
+}
 
-            final1 = vshrq_n_s32(final1, 6);
-            final2 = vshrq_n_s32(final2, 6);
+// [1 2 1] over src[-1 .. n - 1]; the last sample is kept
+static void FUNC(intra_smooth)(pixel *dst, const pixel *src, int n)
+{
+    int i = 0;
 
-            int16x4_t f_sum0 = vqmovn_s32(final1);
-            int16x4_t f_sum1 = vqmovn_s32(final2);
+#if INTRA_VECTOR
+    for (; i + 8 < n; i += 8)
+    {
+        uint16x8_t v = vaddq_u16(FUNC(load_pixels8)(src + i - 1), FUNC(load_pixels8)(src + i + 1));
 
-            vst1_s16(dst + x, f_sum0);
-            vst1_s16(dst + x + 4, f_sum1);
-        }
-        tmp += MAX_PB_SIZE;
-        dst += MAX_PB_SIZE;
+        v = vaddq_u16(v, vshlq_n_u16(FUNC(load_pixels8)(src + i), 1));
+        FUNC(store_pixels8)(dst + i, vrshrq_n_u16(v, 2));
     }
 #endif
+    for (; i < n - 1; i++)
+    {
+        dst[i] = (src[i - 1] + 2 * src[i] + src[i + 1] + 2) >> 2;
+    }
+    dst[n - 1] = src[n - 1];
 }
-// END OF THE FUNCTION
 
-static void FUNC(put_hevc_qpel_uni_h)(uint8_t *_dst, ptrdiff_t _dststride,
-                                      uint8_t *_src, ptrdiff_t _srcstride,
-                                      int height, intptr_t mx, intptr_t my, int width)
+// strong smoothing: the 63 samples between a and b on a straight line
+static void FUNC(intra_ramp)(pixel *dst, int a, int b)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_qpel_filters[mx - 1];
-    int shift = 14 - BIT_DEPTH;
+    int i = 0;
 
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+#if INTRA_VECTOR
+    static const uint16_t ramp[8] = {1, 2, 3, 4, 5, 6, 7, 8};
 
-    for (y = 0; y < height; y++)
+    for (; i + 8 <= 56; i += 8)
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) + offset) >> shift);
-        }
-        src += srcstride;
-        dst += dststride;
+        uint16x8_t w = vaddq_u16(vld1q_u16(ramp), vdupq_n_u16(i));
+        uint16x8_t v = vmlaq_n_u16(vmulq_n_u16(vsubq_u16(vdupq_n_u16(64), w), a), w, b);
+
+        FUNC(store_pixels8)(dst + i, vrshrq_n_u16(v, 6));
+    }
+#endif
+    for (; i < 63; i++)
+    {
+        dst[i] = ((63 - i) * a + (i + 1) * b + 32) >> 6;
     }
 }
 
-static void FUNC(put_hevc_qpel_bi_h)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                     int16_t *src2,
-                                     int height, intptr_t mx, intptr_t my, int width)
+// Writes the filtered references to ftop / fleft, which like top / left
+// start at index -1, and returns 1. It returns 0, writing nothing, when
+// the mode and size call for no filtering. The caller skips this for
+// chroma unless the format is 4:4:4, and when the SPS disables intra
+// smoothing. strong is the SPS strong_intra_smoothing flag (luma only).
+static int FUNC(intra_filter_ref)(uint8_t *_ftop, uint8_t *_fleft, const uint8_t *_top, const uint8_t *_left,
+                                  int log2_size, int mode, int strong)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-
-    const int8_t *filter = uhd_hevc_qpel_filters[mx - 1];
+    static const int hor_ver_dist_thresh[3] = {7, 1, 0};
+    pixel *ftop = (pixel *)_ftop;
+    pixel *fleft = (pixel *)_fleft;
+    const pixel *top = (const pixel *)_top;
+    const pixel *left = (const pixel *)_left;
+    int size = 1 << log2_size;
+    int threshold = 1 << (BIT_DEPTH - 5);
 
-    int shift = 14 + 1 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    if (mode == 1 || size == 4 ||
+        UHDMIN(UHDABS(mode - 26), UHDABS(mode - 10)) <= hor_ver_dist_thresh[log2_size - 3])
+    {
+        return 0;
+    }
 
-    for (y = 0; y < height; y++)
+    if (strong && log2_size == 5 &&
+        UHDABS(top[-1] + top[63] - 2 * top[31]) < threshold &&
+        UHDABS(left[-1] + left[63] - 2 * left[31]) < threshold)
+    {
+        FUNC(intra_ramp)(ftop, top[-1], top[63]);
+        FUNC(intra_ramp)(fleft, left[-1], left[63]);
+        ftop[-1] = fleft[-1] = top[-1];
+        ftop[63] = top[63];
+        fleft[63] = left[63];
+    }
+    else
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) + src2[x] + offset) >> shift);
-        }
-        src += srcstride;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+        FUNC(intra_smooth)(ftop, top, 2 * size);
+        FUNC(intra_smooth)(fleft, left, 2 * size);
+        ftop[-1] = fleft[-1] = (left[0] + 2 * top[-1] + top[0] + 2) >> 2;
     }
+    return 1;
 }
 
-static void FUNC(put_hevc_qpel_uni_v)(uint8_t *_dst, ptrdiff_t _dststride,
-                                      uint8_t *_src, ptrdiff_t _srcstride,
-                                      int height, intptr_t mx, intptr_t my, int width)
+static uhd_always_inline void FUNC(pred_planar)(uint8_t *_src, const uint8_t *_top, const uint8_t *_left,
+                                                ptrdiff_t stride, int trafo_size)
 {
-    int x, y;
     pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
-    int shift = 14 - BIT_DEPTH;
+    const pixel *top = (const pixel *)_top;
+    const pixel *left = (const pixel *)_left;
+    int size = 1 << trafo_size;
+    int x, y;
 
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    stride /= sizeof(pixel);
+#if INTRA_VECTOR
+    // Row y is the row above plus left[size] - top[x]. The uint16 lanes wrap
+    // on the way down but every row total is in range.
+    static const uint16_t ramp[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    int16x8_t shift = vdupq_n_s16(-(trafo_size + 1));
+    int n = UHDMIN(size, 8);
+
+    for (x = 0; x < size; x += 8)
+    {
+        uint16x8_t x1 = vaddq_u16(vld1q_u16(ramp), vdupq_n_u16(x));
+        uint16x8_t t = FUNC(load_pixels8)(top + x);
+        uint16x8_t wl = vsubq_u16(vdupq_n_u16(size), x1);
+        uint16x8_t step = vsubq_u16(vdupq_n_u16(left[size]), t);
+        uint16x8_t row = vmlaq_n_u16(vmlaq_n_u16(vdupq_n_u16(left[size] + size), t, size - 1), x1, top[size]);
 
-    for (y = 0; y < height; y++)
+        for (y = 0; y < size; y++)
+        {
+            FUNC(intra_store)(src + y * stride + x, vshlq_u16(vmlaq_n_u16(row, wl, left[y]), shift), n);
+            row = vaddq_u16(row, step);
+        }
+    }
+#else
+    for (y = 0; y < size; y++)
     {
-        for (x = 0; x < width; x++)
+        for (x = 0; x < size; x++)
         {
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) + offset) >> shift);
+            src[y * stride + x] = ((size - 1 - x) * left[y] + (x + 1) * top[size] +
+                                   (size - 1 - y) * top[x] + (y + 1) * left[size] + size) >> (trafo_size + 1);
         }
-        src += srcstride;
-        dst += dststride;
     }
+#endif
 }
 
-static void FUNC(put_hevc_qpel_bi_v)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                     int16_t *src2,
-                                     int height, intptr_t mx, intptr_t my, int width)
+static void FUNC(pred_dc)(uint8_t *_src, const uint8_t *_top, const uint8_t *_left,
+                          ptrdiff_t stride, int log2_size, int c_idx)
 {
-    int x, y;
     pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    const pixel *top = (const pixel *)_top;
+    const pixel *left = (const pixel *)_left;
+    int size = 1 << log2_size;
+    int dc = size;
+    int x = 0, y;
 
-    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
+    stride /= sizeof(pixel);
+#if INTRA_VECTOR
+    if (size == 4)
+    {
+        dc += vaddlvq_u16(FUNC(cost_load4x2)(top, left));
+    }
+    else
+    {
+        uint32x4_t sum = vdupq_n_u32(0);
 
-    int shift = 14 + 1 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
+        for (y = 0; y < size; y += 8)
+        {
+            sum = vpadalq_u16(sum, FUNC(load_pixels8)(top + y));
+            sum = vpadalq_u16(sum, FUNC(load_pixels8)(left + y));
+        }
+        dc += vaddvq_u32(sum);
+    }
 #else
-    int offset = 0;
+    for (y = 0; y < size; y++)
+    {
+        dc += left[y] + top[y];
+    }
 #endif
+    dc >>= log2_size + 1;
 
-    for (y = 0; y < height; y++)
+    for (y = 0; y < size; y++)
     {
-        for (x = 0; x < width; x++)
+        FUNC(emulated_edge_fill)(src + y * stride, dc, size);
+    }
+
+    if (c_idx == 0 && size < 32)
+    {
+#if INTRA_VECTOR
+        uint16x8_t dc3 = vdupq_n_u16(3 * dc + 2);
+
+        for (; x < size; x += 8)
         {
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) + src2[x] + offset) >> shift);
+            FUNC(intra_store)(src + x, vshrq_n_u16(vaddq_u16(FUNC(load_pixels8)(top + x), dc3), 2),
+                              UHDMIN(size, 8));
         }
-        src += srcstride;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+#else
+        for (; x < size; x++)
+        {
+            src[x] = (top[x] + 3 * dc + 2) >> 2;
+        }
+#endif
+        for (y = 1; y < size; y++)
+        {
+            src[y * stride] = (left[y] + 3 * dc + 2) >> 2;
+        }
+        src[0] = (left[0] + 2 * dc + top[0] + 2) >> 2;
     }
 }
 
-// START OF QPEL_UNI_HV
+// one row of 2-tap angular interpolation between ref[x] and ref[x + 1]
+static uhd_always_inline void FUNC(intra_interp_row)(pixel *dst, const pixel *ref, int fact, int size)
+{
+    int x;
 
-#define QPEL_UNI_VECTOR1
-#define QPEL_UNI_VECTOR2
+#if INTRA_VECTOR
+    uint16x8_t w0 = vdupq_n_u16(32 - fact);
+    uint16x8_t w1 = vdupq_n_u16(fact);
+    int n = UHDMIN(size, 8);
 
-static void FUNC(put_hevc_qpel_uni_hv)(uint8_t *_dst, ptrdiff_t _dststride,
-                                       uint8_t *_src, ptrdiff_t _srcstride,
-                                       int height, intptr_t mx, intptr_t my, int width)
-{
-    int x, y;
-    const int16_t *filter;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    int16_t tmp_array[(MAX_PB_SIZE + QPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    int shift = 14 - BIT_DEPTH;
+    for (x = 0; x < size; x += 8)
+    {
+        uint16x8_t v = vmlaq_u16(vmulq_u16(FUNC(load_pixels8)(ref + x), w0), FUNC(load_pixels8)(ref + x + 1), w1);
 
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
+        FUNC(intra_store)(dst + x, vrshrq_n_u16(v, 5), n);
+    }
 #else
-    int offset = 0;
+    for (x = 0; x < size; x++)
+    {
+        dst[x] = ((32 - fact) * ref[x] + fact * ref[x + 1] + 16) >> 5;
+    }
 #endif
+}
 
-    src -= QPEL_EXTRA_BEFORE * srcstride;
+// Horizontal modes (2 .. 17) are the vertical ones mirrored about the
+// diagonal: they are predicted row by row into tmp from the left
+// references and transposed into place.
+static uhd_always_inline void FUNC(pred_angular)(uint8_t *_src, const uint8_t *_top, const uint8_t *_left,
+                                                 ptrdiff_t stride, int c_idx, int mode, int size)
+{
+    static const int intra_pred_angle[] = {
+        32, 26, 21, 17, 13, 9, 5, 2, 0, -2, -5, -9, -13, -17, -21, -26, -32,
+        -26, -21, -17, -13, -9, -5, -2, 0, 2, 5, 9, 13, 17, 21, 26, 32};
+    static const int inv_angle[] = {
+        -4096, -1638, -910, -630, -482, -390, -315, -256, -315, -390, -482,
+        -630, -910, -1638, -4096};
+    pixel *src = (pixel *)_src;
+    const pixel *top = (const pixel *)_top;
+    const pixel *left = (const pixel *)_left;
+    const pixel *main_ref = mode >= 18 ? top : left;
+    const pixel *side_ref = mode >= 18 ? left : top;
+    int angle = intra_pred_angle[mode - 2];
+    int last = (size * angle) >> 5;
+    // the main references from the corner on, room before them for the
+    // projected side references and zeros after them for the 8-lane reads
+    pixel ref_array[3 * 32 + 16];
+    pixel *ref = ref_array + size;
+    pixel tmp[32 * 32];
+    pixel *dst;
+    ptrdiff_t dststride;
+    int x, y;
 
-#ifdef QPEL_UNI_SCALAR1
-    filter = qpel_filter_size8[mx - 1];
-    for (y = 0; y < height + QPEL_EXTRA; y++)
+    stride /= sizeof(pixel);
+    if (mode >= 18)
     {
-        for (x = 0; x < width; x++)
+        dst = src;
+        dststride = stride;
+    }
+    else
+    {
+        dst = tmp;
+        dststride = size;
+    }
+
+    memcpy(ref, main_ref - 1, (2 * size + 1) * sizeof(pixel));
+    memset(ref + 2 * size + 1, 0, 8 * sizeof(pixel));
+    if (angle < 0 && last < -1)
+    {
+        for (x = last; x <= -1; x++)
         {
-            tmp[x] = QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            ref[x] = side_ref[-1 + ((x * inv_angle[mode - 11] + 128) >> 8)];
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
-    }
-#endif
-
-#ifdef QPEL_UNI_VECTOR1
-    int shifts = BIT_DEPTH - 8;
-    int yval = height + QPEL_EXTRA;
-    filter = qpel_filter_size8[mx - 1];
-
-    #if BIT_DEPTH > 8
-            int16x4_t fil0 = vdup_n_s16(filter[0]);
-            int16x4_t fil1 = vdup_n_s16(filter[1]);
-            int16x4_t fil2 = vdup_n_s16(filter[2]);
-            int16x4_t fil3 = vdup_n_s16(filter[3]);
-            int16x4_t fil4 = vdup_n_s16(filter[4]);
-            int16x4_t fil5 = vdup_n_s16(filter[5]);
-            int16x4_t fil6 = vdup_n_s16(filter[6]);
-            int16x4_t fil7 = vdup_n_s16(filter[7]);
-    #else
-            int16x8_t fil0 = vdupq_n_s16(filter[0]);
-            int16x8_t fil1 = vdupq_n_s16(filter[1]);
-            int16x8_t fil2 = vdupq_n_s16(filter[2]);
-            int16x8_t fil3 = vdupq_n_s16(filter[3]);
-            int16x8_t fil4 = vdupq_n_s16(filter[4]);
-            int16x8_t fil5 = vdupq_n_s16(filter[5]);
-            int16x8_t fil6 = vdupq_n_s16(filter[6]);
-            int16x8_t fil7 = vdupq_n_s16(filter[7]);
-    #endif
-
-    for (y = 0; y < yval; y++)
+    }
+
+    for (y = 0; y < size; y++)
     {
-        for (x = 0; x < width; x += 8)
+        int idx = ((y + 1) * angle) >> 5;
+        int fact = ((y + 1) * angle) & 31;
+
+        if (fact)
+        {
+            FUNC(intra_interp_row)(dst + y * dststride, ref + idx + 1, fact, size);
+        }
+        else
         {
-        #if BIT_DEPTH > 8
-            int32x4_t final1 = vdupq_n_s32(0);
-            int32x4_t final2 = vdupq_n_s32(0);
+            memcpy(dst + y * dststride, ref + idx + 1, size * sizeof(pixel));
+        }
+    }
 
-            uint16_t *ptr;
-            ptr = src + x;
-            int16x4_t src0 = vreinterpret_s16_u16(vld1_u16(ptr - 3));
-            int16x4_t src1 = vreinterpret_s16_u16(vld1_u16(ptr + 1));
+    if (mode < 18)
+    {
+        for (y = 0; y < size; y++)
+        {
+            for (x = 0; x < size; x++)
+            {
+                src[y * stride + x] = tmp[x * size + y];
+            }
+        }
+    }
 
-            int16x4_t src2 = vreinterpret_s16_u16(vld1_u16(ptr - 2));
-            int16x4_t src3 = vreinterpret_s16_u16(vld1_u16(ptr + 2));
+    if (mode == 26 && c_idx == 0 && size < 32)
+    {
+        for (y = 0; y < size; y++)
+        {
+            src[y * stride] = uhd_clip_pixel(top[0] + ((left[y] - left[-1]) >> 1));
+        }
+    }
+    else if (mode == 10 && c_idx == 0 && size < 32)
+    {
+        for (x = 0; x < size; x++)
+        {
+            src[x] = uhd_clip_pixel(left[0] + ((top[x] - top[-1]) >> 1));
+        }
+    }
+}
 
-            int16x4_t src4 = vreinterpret_s16_u16(vld1_u16(ptr - 1));
-            int16x4_t src5 = vreinterpret_s16_u16(vld1_u16(ptr + 3));
+#define PRED_SIZE(n, log2_size)                                                                          \
+    static void FUNC(pred_planar_##n)(uint8_t *src, const uint8_t *top, const uint8_t *left,             \
+                                      ptrdiff_t stride)                                                  \
+    {                                                                                                    \
+        FUNC(pred_planar)(src, top, left, stride, log2_size);                                            \
+    }                                                                                                    \
+    static void FUNC(pred_angular_##n)(uint8_t *src, const uint8_t *top, const uint8_t *left,            \
+                                       ptrdiff_t stride, int c_idx, int mode)                            \
+    {                                                                                                    \
+        FUNC(pred_angular)(src, top, left, stride, c_idx, mode, 1 << log2_size);                         \
+    }
 
-            int16x4_t src6 = vreinterpret_s16_u16(vld1_u16(ptr));
-            int16x4_t src7 = vreinterpret_s16_u16(vld1_u16(ptr + 4));
+PRED_SIZE(0, 2)
+PRED_SIZE(1, 3)
+PRED_SIZE(2, 4)
+PRED_SIZE(3, 5)
 
-            int16x4_t src8 = vreinterpret_s16_u16(vld1_u16(ptr + 1));
-            int16x4_t src9 = vreinterpret_s16_u16(vld1_u16(ptr + 5));
+#undef PRED_SIZE
+#undef INTRA_VECTOR
 
-            int16x4_t src10 = vreinterpret_s16_u16(vld1_u16(ptr + 2));
-            int16x4_t src11 = vreinterpret_s16_u16(vld1_u16(ptr + 6));
+////////////////////////////////////////////////////////////////////////////////
+// Kernel profiling (build with UHD_KERNEL_PROFILE). The dispatch table points
+// at the name_prof wrappers below instead of the kernels; each call is counted
+// per kernel, bit depth, block size and mode key, and a report sorted by time
+// is printed to stderr at exit. The key is the fractional MV for MC and the
+// class for SAO; the other wrappers say what they put in mx/my. The deblocking
+// wrappers follow the deblocking filters at the end of the file.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef UHD_TICKS
+#define UHD_TICKS
+#include <time.h>
 
-            int16x4_t src12 = vreinterpret_s16_u16(vld1_u16(ptr + 3));
-            int16x4_t src13 = vreinterpret_s16_u16(vld1_u16(ptr + 7));
+// timestamp for profiling and tuning: the generic timer (cntvct_el0) on
+// AArch64, CLOCK_MONOTONIC nanoseconds elsewhere
+static inline uint64_t uhd_ticks(void)
+{
+#if defined(__aarch64__)
+    uint64_t t;
 
-            int16x4_t src14 = vreinterpret_s16_u16(vld1_u16(ptr + 4));
-            int16x4_t src15 = vreinterpret_s16_u16(vld1_u16(ptr + 8));
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(t) : : "memory");
+    return t;
+#else
+    struct timespec ts;
 
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
 
-            final1 = vmlal_s16(final1, src0 , fil0);
-            final2 = vmlal_s16(final2, src1 , fil0);
+static inline uint64_t uhd_ticks_per_second(void)
+{
+#if defined(__aarch64__)
+    uint64_t f;
 
-            final1 = vmlal_s16(final1, src2 , fil1);
-            final2 = vmlal_s16(final2, src3 , fil1);
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(f));
+    return f;
+#else
+    return 1000000000u;
+#endif
+}
+#endif
 
-            final1 = vmlal_s16(final1, src4 , fil2);
-            final2 = vmlal_s16(final2, src5 , fil2);
+#ifdef UHD_KERNEL_PROFILE
+#ifndef UHD_KERNEL_PROFILE_STATS
+#define UHD_KERNEL_PROFILE_STATS
+#include <stdio.h>
 
-            final1 = vmlal_s16(final1, src6 , fil3);
-            final2 = vmlal_s16(final2, src7 , fil3);
+#define UHD_PROF_SLOTS 4096 // power of two
 
-            final1 = vmlal_s16(final1, src8 , fil4);
-            final2 = vmlal_s16(final2, src9 , fil4);
+typedef struct UHDKernelStat
+{
+    const char *name; // NULL while the slot is free
+    int bit_depth;
+    int width;
+    int height;
+    int mx;
+    int my;
+    uint64_t calls;
+    uint64_t pixels;
+    uint64_t ticks;
+} UHDKernelStat;
+
+static UHDKernelStat uhd_prof_stats[UHD_PROF_SLOTS];
+static int uhd_prof_lock;
+static int uhd_prof_used;
+
+static int uhd_prof_cmp(const void *a, const void *b)
+{
+    uint64_t ta = (*(const UHDKernelStat *const *)a)->ticks;
+    uint64_t tb = (*(const UHDKernelStat *const *)b)->ticks;
 
-            final1 = vmlal_s16(final1, src10 , fil5);
-            final2 = vmlal_s16(final2, src11 , fil5);
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
 
-            final1 = vmlal_s16(final1, src12 , fil6);
-            final2 = vmlal_s16(final2, src13 , fil6);
+static void uhd_prof_report(void)
+{
+    static const UHDKernelStat *sorted[UHD_PROF_SLOTS];
+    uint64_t total = 0;
+    int i, n = 0;
 
-            final1 = vmlal_s16(final1, src14 , fil7);
-            final2 = vmlal_s16(final2, src15 , fil7);
+    for (i = 0; i < UHD_PROF_SLOTS; i++)
+    {
+        if (uhd_prof_stats[i].name)
+        {
+            sorted[n++] = &uhd_prof_stats[i];
+            total += uhd_prof_stats[i].ticks;
+        }
+    }
+    qsort(sorted, n, sizeof(*sorted), uhd_prof_cmp);
 
-            final1 = vshrq_n_s32(final1, shifts);
-            final2 = vshrq_n_s32(final2, shifts);
+    fprintf(stderr, "%-28s %5s %7s %5s %12s %14s %14s %9s %6s\n",
+            "kernel", "depth", "block", "mx/my", "calls", "pixels", "ticks", "ticks/px", "share");
+    for (i = 0; i < n; i++)
+    {
+        const UHDKernelStat *s = sorted[i];
 
-            int16x4_t intt1 = vmovn_s32(final1);
-            int16x4_t intt2 = vmovn_s32(final2);
+        fprintf(stderr, "%-28s %5d %3dx%-3d %2d/%-2d %12llu %14llu %14llu %9.3f %5.1f%%\n",
+                s->name, s->bit_depth, s->width, s->height, s->mx, s->my,
+                (unsigned long long)s->calls, (unsigned long long)s->pixels, (unsigned long long)s->ticks,
+                s->pixels ? (double)s->ticks / s->pixels : 0.0,
+                total ? 100.0 * s->ticks / total : 0.0);
+    }
+}
 
-            vst1_s16(tmp + x, intt1);
-            vst1_s16(tmp + x + 4, intt2);
+// Finds or claims the slot for one kernel/depth/size/fraction; NULL once the
+// table is full. Lookups are lock-free, only claiming a free slot locks.
+static UHDKernelStat *uhd_prof_slot(const char *name, int bit_depth, int width, int height, int mx, int my)
+{
+    uint32_t h = (uint32_t)(uintptr_t)name;
+    int i, n;
 
-        #else
-            int16x8_t final = vdupq_n_s16(0);
-            uint8_t *ptr;
-            ptr = src + x;
-            int16x8_t src0 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 3)));
-            int16x8_t src1 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 2)));
-            int16x8_t src2 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 1)));
-            int16x8_t src3 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr)));
-            int16x8_t src4 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 1)));
-            int16x8_t src5 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 2)));
-            int16x8_t src6 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 3)));
-            int16x8_t src7 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 4)));
+    h = (h ^ (bit_depth << 24) ^ (width << 16) ^ (height << 8) ^ (mx << 4) ^ my) * 0x9e3779b1u;
+    i = h >> 20;
+    for (n = 0; n < UHD_PROF_SLOTS; n++, i = (i + 1) & (UHD_PROF_SLOTS - 1))
+    {
+        UHDKernelStat *s = &uhd_prof_stats[i];
+        const char *slot_name = __atomic_load_n(&s->name, __ATOMIC_ACQUIRE);
 
-            final = vmlaq_s16(final, src0, fil0);
-            final = vmlaq_s16(final, src1, fil1);
-            final = vmlaq_s16(final, src2, fil2);
-            final = vmlaq_s16(final, src3, fil3);
-            final = vmlaq_s16(final, src4, fil4);
-            final = vmlaq_s16(final, src5, fil5);
-            final = vmlaq_s16(final, src6, fil6);
-            final = vmlaq_s16(final, src7, fil7);
-            final = vshrq_n_s16(final, shifts);
-            vst1q_s16(tmp + x, final);
-    #endif
+        if (!slot_name)
+        {
+            while (__atomic_exchange_n(&uhd_prof_lock, 1, __ATOMIC_ACQUIRE))
+                ;
+            if (!s->name)
+            {
+                s->bit_depth = bit_depth;
+                s->width = width;
+                s->height = height;
+                s->mx = mx;
+                s->my = my;
+                if (!uhd_prof_used++)
+                {
+                    atexit(uhd_prof_report);
+                }
+                __atomic_store_n(&s->name, name, __ATOMIC_RELEASE);
+            }
+            __atomic_store_n(&uhd_prof_lock, 0, __ATOMIC_RELEASE);
+            slot_name = s->name;
+        }
+        if (slot_name == name && s->bit_depth == bit_depth && s->width == width && s->height == height &&
+            s->mx == mx && s->my == my)
+        {
+            return s;
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
     }
-#endif
+    return NULL;
+}
 
-#ifdef QPEL_UNI_SCALAR2
-    tmp = tmp_array + QPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_qpel_filters[my - 1];
+static inline void uhd_prof_add(const char *name, int bit_depth, int width, int height, int mx, int my,
+                                uint64_t start)
+{
+    uint64_t ticks = uhd_ticks() - start;
+    UHDKernelStat *s = uhd_prof_slot(name, bit_depth, width, height, mx, my);
 
-    for (y = 0; y < height; y++)
+    if (s)
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) + offset) >> shift);
-           // printf("\n%d",dst[x]);
-        }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
+        __atomic_fetch_add(&s->calls, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->pixels, (uint64_t)width * height, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->ticks, ticks, __ATOMIC_RELAXED);
     }
-    //exit(0);
+}
 #endif
 
-#ifdef QPEL_UNI_VECTOR2
-    int16_t *str;
-    tmp = tmp_array + 192;
-    filter = qpel_filter_size8[my - 1];
+#define PUT_PROF(name)                                                                               \
+    static void FUNC(name##_prof)(int16_t *dst, uint8_t *_src, ptrdiff_t _srcstride,                 \
+                                  int height, intptr_t mx, intptr_t my, int width)                   \
+    {                                                                                                \
+        uint64_t start = uhd_ticks();                                                                \
+                                                                                                     \
+        FUNC(name)(dst, _src, _srcstride, height, mx, my, width);                                    \
+        uhd_prof_add(#name, BIT_DEPTH, width, height, mx, my, start);                                \
+    }
 
-    int16x8_t offvector = vdupq_n_s16(offset);
-    // int32x4_t max = vdupq_n_s32((1 << BIT_DEPTH) - 1);
-    // int32x4_t min = vdupq_n_s32(0);
+#define PUT_PROF_UNI(name)                                                                                   \
+    static void FUNC(name##_prof)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride, \
+                                  int height, intptr_t mx, intptr_t my, int width)                          \
+    {                                                                                                        \
+        uint64_t start = uhd_ticks();                                                                        \
+                                                                                                             \
+        FUNC(name)(_dst, _dststride, _src, _srcstride, height, mx, my, width);                               \
+        uhd_prof_add(#name, BIT_DEPTH, width, height, mx, my, start);                                        \
+    }
 
-    int16x8_t max = vdupq_n_s16((1 << BIT_DEPTH) - 1);
-    int16x8_t min = vdupq_n_s16(0);
+#define PUT_PROF_BI(name)                                                                                    \
+    static void FUNC(name##_prof)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride, \
+                                  int16_t *src2, int height, intptr_t mx, intptr_t my, int width)            \
+    {                                                                                                        \
+        uint64_t start = uhd_ticks();                                                                        \
+                                                                                                             \
+        FUNC(name)(_dst, _dststride, _src, _srcstride, src2, height, mx, my, width);                         \
+        uhd_prof_add(#name, BIT_DEPTH, width, height, mx, my, start);                                        \
+    }
 
-    int16x4_t filt0 = vdup_n_s16(filter[0]);
-    int16x4_t filt1 = vdup_n_s16(filter[1]);
-    int16x4_t filt2 = vdup_n_s16(filter[2]);
-    int16x4_t filt3 = vdup_n_s16(filter[3]);
-    int16x4_t filt4 = vdup_n_s16(filter[4]);
-    int16x4_t filt5 = vdup_n_s16(filter[5]);
-    int16x4_t filt6 = vdup_n_s16(filter[6]);
-    int16x4_t filt7 = vdup_n_s16(filter[7]);
+#define PUT_PROF_UNI_W(name)                                                                                 \
+    static void FUNC(name##_prof)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride, \
+                                  int height, int denom, int wx, int ox,                                     \
+                                  intptr_t mx, intptr_t my, int width)                                       \
+    {                                                                                                        \
+        uint64_t start = uhd_ticks();                                                                        \
+                                                                                                             \
+        FUNC(name)(_dst, _dststride, _src, _srcstride, height, denom, wx, ox, mx, my, width);                \
+        uhd_prof_add(#name, BIT_DEPTH, width, height, mx, my, start);                                        \
+    }
 
-    for (y = 0; y < height; y++)
-    {
-        for (x = 0; x < width; x += 8)
-        {
-            str = tmp + x;
-            int32x4_t final1 = vdupq_n_s32(0);
-            int32x4_t final2 = vdupq_n_s32(0);
+#define PUT_PROF_BI_W(name)                                                                                  \
+    static void FUNC(name##_prof)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride, \
+                                  int16_t *src2, int height, int denom, int wx0, int wx1,                    \
+                                  int ox0, int ox1, intptr_t mx, intptr_t my, int width)                     \
+    {                                                                                                        \
+        uint64_t start = uhd_ticks();                                                                        \
+                                                                                                             \
+        FUNC(name)(_dst, _dststride, _src, _srcstride, src2, height, denom, wx0, wx1,                        \
+                   ox0, ox1, mx, my, width);                                                                 \
+        uhd_prof_add(#name, BIT_DEPTH, width, height, mx, my, start);                                        \
+    }
+
+PUT_PROF(put_hevc_pel_pixels)
+PUT_PROF_UNI(put_hevc_pel_uni_pixels)
+PUT_PROF_BI(put_hevc_pel_bi_pixels)
+PUT_PROF_UNI_W(put_hevc_pel_uni_w_pixels)
+PUT_PROF_BI_W(put_hevc_pel_bi_w_pixels)
+
+PUT_PROF(put_hevc_qpel_h)
+PUT_PROF(put_hevc_qpel_v)
+PUT_PROF(put_hevc_qpel_hv)
+PUT_PROF_UNI(put_hevc_qpel_uni_h)
+PUT_PROF_UNI(put_hevc_qpel_uni_v)
+PUT_PROF_UNI(put_hevc_qpel_uni_hv)
+PUT_PROF_BI(put_hevc_qpel_bi_h)
+PUT_PROF_BI(put_hevc_qpel_bi_v)
+PUT_PROF_BI(put_hevc_qpel_bi_hv)
+PUT_PROF_UNI_W(put_hevc_qpel_uni_w_h)
+PUT_PROF_UNI_W(put_hevc_qpel_uni_w_v)
+PUT_PROF_UNI_W(put_hevc_qpel_uni_w_hv)
+PUT_PROF_BI_W(put_hevc_qpel_bi_w_h)
+PUT_PROF_BI_W(put_hevc_qpel_bi_w_v)
+PUT_PROF_BI_W(put_hevc_qpel_bi_w_hv)
+
+PUT_PROF(put_hevc_epel_h)
+PUT_PROF(put_hevc_epel_v)
+PUT_PROF(put_hevc_epel_hv)
+PUT_PROF_UNI(put_hevc_epel_uni_h)
+PUT_PROF_UNI(put_hevc_epel_uni_v)
+PUT_PROF_UNI(put_hevc_epel_uni_hv)
+PUT_PROF_BI(put_hevc_epel_bi_h)
+PUT_PROF_BI(put_hevc_epel_bi_v)
+PUT_PROF_BI(put_hevc_epel_bi_hv)
+PUT_PROF_UNI_W(put_hevc_epel_uni_w_h)
+PUT_PROF_UNI_W(put_hevc_epel_uni_w_v)
+PUT_PROF_UNI_W(put_hevc_epel_uni_w_hv)
+PUT_PROF_BI_W(put_hevc_epel_bi_w_h)
+PUT_PROF_BI_W(put_hevc_epel_bi_w_v)
+PUT_PROF_BI_W(put_hevc_epel_bi_w_hv)
+
+// SAO is counted per CTB; the class (band position or edge direction) goes in mx
+static void FUNC(sao_band_filter_prof)(uint8_t *_dst, uint8_t *_src,
+                                       ptrdiff_t stride_dst, ptrdiff_t stride_src,
+                                       int16_t *sao_offset_val, int sao_left_class,
+                                       int width, int height)
+{
+    uint64_t start = uhd_ticks();
 
-            int16x4_t src0 = vld1_s16(str - 192);
-            int16x4_t src1 = vld1_s16(str - 188);
+    FUNC(sao_band_filter)(_dst, _src, stride_dst, stride_src, sao_offset_val, sao_left_class, width, height);
+    uhd_prof_add("sao_band_filter", BIT_DEPTH, width, height, sao_left_class, 0, start);
+}
+
+static void FUNC(sao_edge_filter_prof)(uint8_t *_dst, uint8_t *_src, ptrdiff_t stride_dst,
+                                       int16_t *sao_offset_val, int eo, int width, int height)
+{
+    uint64_t start = uhd_ticks();
+
+    FUNC(sao_edge_filter)(_dst, _src, stride_dst, sao_offset_val, eo, width, height);
+    uhd_prof_add("sao_edge_filter", BIT_DEPTH, width, height, eo, 0, start);
+}
 
-            int16x4_t src2 = vld1_s16(str - 128);
-            int16x4_t src3 = vld1_s16(str - 124);
+// The transform kernels are counted per TU size. idct keys on col_limit (in
+// mx), the dequantizers on whether a scaling list is in use.
+#define TRANSFORM_PROF(H)                                                                        \
+    static void FUNC(idct_##H##x##H##_prof)(int16_t * coeffs, int col_limit)                     \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(idct_##H##x##H)(coeffs, col_limit);                                                 \
+        uhd_prof_add("idct_" #H "x" #H, BIT_DEPTH, H, H, col_limit, 0, start);                   \
+    }                                                                                            \
+    static void FUNC(idct_##H##x##H##_dc_prof)(int16_t * coeffs)                                 \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(idct_##H##x##H##_dc)(coeffs);                                                       \
+        uhd_prof_add("idct_" #H "x" #H "_dc", BIT_DEPTH, H, H, 0, 0, start);                     \
+    }                                                                                            \
+    static void FUNC(idct_dequant_##H##x##H##_prof)(int16_t * coeffs, int col_limit, int qp,     \
+                                                    const uint8_t *sm, int sm_dc)                \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(idct_dequant_##H##x##H)(coeffs, col_limit, qp, sm, sm_dc);                          \
+        uhd_prof_add("idct_dequant_" #H "x" #H, BIT_DEPTH, H, H, col_limit, !!sm, start);        \
+    }                                                                                            \
+    static void FUNC(dequant_##H##x##H##_prof)(int16_t * coeffs, int qp, const uint8_t *sm,      \
+                                               int sm_dc)                                        \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(dequant_##H##x##H)(coeffs, qp, sm, sm_dc);                                          \
+        uhd_prof_add("dequant_" #H "x" #H, BIT_DEPTH, H, H, !!sm, 0, start);                     \
+    }                                                                                            \
+    static void FUNC(fdct_##H##x##H##_prof)(int16_t * coeffs)                                    \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(fdct_##H##x##H)(coeffs);                                                            \
+        uhd_prof_add("fdct_" #H "x" #H, BIT_DEPTH, H, H, 0, 0, start);                           \
+    }                                                                                            \
+    static void FUNC(transform_add##H##x##H##_prof)(uint8_t * _dst, int16_t * coeffs,            \
+                                                    ptrdiff_t stride)                            \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(transform_add##H##x##H)(_dst, coeffs, stride);                                      \
+        uhd_prof_add("transform_add" #H "x" #H, BIT_DEPTH, H, H, 0, 0, start);                   \
+    }
 
-            int16x4_t src4 = vld1_s16(str - 64);
-            int16x4_t src5 = vld1_s16(str - 60);
+TRANSFORM_PROF(4)
+TRANSFORM_PROF(8)
+TRANSFORM_PROF(16)
+TRANSFORM_PROF(32)
 
-            int16x4_t src6 = vld1_s16(str);
-            int16x4_t src7 = vld1_s16(str + 4);
+static void FUNC(transform_4x4_luma_prof)(int16_t *coeffs)
+{
+    uint64_t start = uhd_ticks();
 
-            int16x4_t src8 = vld1_s16(str + 64);
-            int16x4_t src9 = vld1_s16(str + 68);
+    FUNC(transform_4x4_luma)(coeffs);
+    uhd_prof_add("transform_4x4_luma", BIT_DEPTH, 4, 4, 0, 0, start);
+}
 
-            int16x4_t src10 = vld1_s16(str + 128);
-            int16x4_t src11 = vld1_s16(str + 132);
+static void FUNC(fdst_4x4_prof)(int16_t *coeffs)
+{
+    uint64_t start = uhd_ticks();
 
-            int16x4_t src12 = vld1_s16(str + 192);
-            int16x4_t src13 = vld1_s16(str + 196);
+    FUNC(fdst_4x4)(coeffs);
+    uhd_prof_add("fdst_4x4", BIT_DEPTH, 4, 4, 0, 0, start);
+}
 
-            int16x4_t src14 = vld1_s16(str + 256);
-            int16x4_t src15 = vld1_s16(str + 260);
+// Intra prediction keys on the mode (in mx) and the component (in my).
+#define PRED_PROF(n, size)                                                                       \
+    static void FUNC(pred_planar_##n##_prof)(uint8_t * src, const uint8_t *top,                  \
+                                             const uint8_t *left, ptrdiff_t stride)              \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(pred_planar_##n)(src, top, left, stride);                                           \
+        uhd_prof_add("pred_planar", BIT_DEPTH, size, size, 0, 0, start);                         \
+    }                                                                                            \
+    static void FUNC(pred_angular_##n##_prof)(uint8_t * src, const uint8_t *top,                 \
+                                              const uint8_t *left, ptrdiff_t stride,             \
+                                              int c_idx, int mode)                               \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(pred_angular_##n)(src, top, left, stride, c_idx, mode);                             \
+        uhd_prof_add("pred_angular", BIT_DEPTH, size, size, mode, c_idx, start);                 \
+    }
 
-            final1 = vmlal_s16(final1, src0, filt0);
-            final2 = vmlal_s16(final2, src1, filt0);
+PRED_PROF(0, 4)
+PRED_PROF(1, 8)
+PRED_PROF(2, 16)
+PRED_PROF(3, 32)
 
-            final1 = vmlal_s16(final1, src2, filt1);
-            final2 = vmlal_s16(final2, src3, filt1);
+static void FUNC(pred_dc_prof)(uint8_t *_src, const uint8_t *_top, const uint8_t *_left,
+                               ptrdiff_t stride, int log2_size, int c_idx)
+{
+    uint64_t start = uhd_ticks();
 
-            final1 = vmlal_s16(final1, src4, filt2);
-            final2 = vmlal_s16(final2, src5, filt2);
+    FUNC(pred_dc)(_src, _top, _left, stride, log2_size, c_idx);
+    uhd_prof_add("pred_dc", BIT_DEPTH, 1 << log2_size, 1 << log2_size, 1, c_idx, start);
+}
 
-            final1 = vmlal_s16(final1, src6, filt3);
-            final2 = vmlal_s16(final2, src7, filt3);
+// The motion search costs key on the number of references (in mx).
+static int FUNC(pixel_sad_prof)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *ref, ptrdiff_t refstride,
+                                int width, int height)
+{
+    uint64_t start = uhd_ticks();
+    int cost = FUNC(pixel_sad)(src, srcstride, ref, refstride, width, height);
 
-            final1 = vmlal_s16(final1, src8, filt4);
-            final2 = vmlal_s16(final2, src9, filt4);
+    uhd_prof_add("pixel_sad", BIT_DEPTH, width, height, 1, 0, start);
+    return cost;
+}
 
-            final1 = vmlal_s16(final1, src10, filt5);
-            final2 = vmlal_s16(final2, src11, filt5);
+static void FUNC(pixel_sad_x3_prof)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *const *ref,
+                                    ptrdiff_t refstride, int width, int height, int *cost)
+{
+    uint64_t start = uhd_ticks();
 
-            final1 = vmlal_s16(final1, src12, filt6);
-            final2 = vmlal_s16(final2, src13, filt6);
+    FUNC(pixel_sad_x3)(src, srcstride, ref, refstride, width, height, cost);
+    uhd_prof_add("pixel_sad", BIT_DEPTH, width, height, 3, 0, start);
+}
 
-            final1 = vmlal_s16(final1, src14, filt7);
-            final2 = vmlal_s16(final2, src15, filt7);
+static void FUNC(pixel_sad_x4_prof)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *const *ref,
+                                    ptrdiff_t refstride, int width, int height, int *cost)
+{
+    uint64_t start = uhd_ticks();
 
-            int16x4_t f_sum0 = vshrn_n_s32(final1, 6);
-            int16x4_t f_sum1 = vshrn_n_s32(final2, 6);
+    FUNC(pixel_sad_x4)(src, srcstride, ref, refstride, width, height, cost);
+    uhd_prof_add("pixel_sad", BIT_DEPTH, width, height, 4, 0, start);
+}
 
-            int16x8_t combined = vcombine_s16(f_sum0, f_sum1);
+static int FUNC(pixel_satd_prof)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *ref, ptrdiff_t refstride,
+                                 int width, int height)
+{
+    uint64_t start = uhd_ticks();
+    int cost = FUNC(pixel_satd)(src, srcstride, ref, refstride, width, height);
 
-            // int16x8_t srcvector = vld1q_s16(src2 + x);
+    uhd_prof_add("pixel_satd", BIT_DEPTH, width, height, 1, 0, start);
+    return cost;
+}
 
-            int16x8_t result = vaddq_s16(combined, offvector);
-            result = vshrq_n_s16(result,shift);
+#undef PUT_PROF
+#undef PUT_PROF_UNI
+#undef PUT_PROF_BI
+#undef PUT_PROF_UNI_W
+#undef PUT_PROF_BI_W
+#undef TRANSFORM_PROF
+#undef PRED_PROF
+#endif
 
-            // int32x4_t result2 = vaddl_s16(vget_low_s16(result1), vget_low_s16(srcvector));
-            // int32x4_t result3 = vaddl_s16(vget_high_s16(result1), vget_high_s16(srcvector));
+////////////////////////////////////////////////////////////////////////////////
+// Start-up auto-tuning. Where a dispatch slot has more than one implementation,
+// uhd_tune_pick times every candidate at a block size and keeps the fastest:
+// qpel per fraction class, the specialized int16 kernels against the generic
+// int32 rows; block costs, dequant and fdct, the vector kernels against the
+// scalar _c references; idct_dequant, fused against dequant then idct. SAO
+// has no runtime alternative, VECTOR_SAO picks its body at build time.
+// Choices are kept in a UHDTuneCache. The cache can be saved to a small text
+// file and loaded on the next launch, so tuning runs once per machine. A file
+// written for another cpu_id is ignored.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef UHD_AUTOTUNE
+#define UHD_AUTOTUNE
+#include <stdio.h>
 
-            // result2 = vshrq_n_s32(result2, shift);
-            // result3 = vshrq_n_s32(result3, shift);
-            uint16x8_t clip00 = vreinterpretq_u16_s16((vminq_s16(max, vmaxq_s16(min, result))));
+#define UHD_TUNE_MAX_ENTRIES 512
+#define UHD_TUNE_ROUNDS 5
+#define UHD_TUNE_REPS 16
 
+typedef struct UHDTuneEntry
+{
+    char slot[32];
+    int bit_depth;
+    int width;
+    int height;
+    int choice;
+} UHDTuneEntry;
+
+typedef struct UHDTuneCache
+{
+    char cpu_id[64];
+    UHDTuneEntry entry[UHD_TUNE_MAX_ENTRIES];
+    int nb_entry;
+    int dirty; // holds choices the file does not have yet
+} UHDTuneCache;
+
+// runs candidate once at width x height
+typedef void (*UHDTuneRun)(void *opaque, int candidate, int width, int height);
+
+// Starts an empty cache for cpu_id (one word, e.g. the MIDR or model name) and
+// fills it from path when the file was written for the same cpu_id. A missing
+// or stale file is not an error.
+static void uhd_tune_cache_load(UHDTuneCache *cache, const char *path, const char *cpu_id)
+{
+    char file_cpu[64];
+    UHDTuneEntry e;
+    FILE *f;
 
-            // uint16x4_t clip0 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, result2))));
-            // uint16x4_t clip1 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, result3))));
-
-           // uint16x8_t opp = vcombine_u16(clip0, clip1);
-            #if BIT_DEPTH > 8
-                // for(int val=0;val<8;val++)
-                // {
-                //     printf("\n%d",clip00[val]);
-                // }
-                vst1q_u16(dst + x, clip00);
-            #else
-            uint8x8_t finale = vqmovn_u16(clip00);
-                // for(int val=0;val<8;val++)
-                // {
-                //     printf("\n%d",finale[val]);
-                // }
-            vst1_u8(dst + x, finale);
-            #endif
-        }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
-       // src2 += MAX_PB_SIZE;
+    memset(cache, 0, sizeof(*cache));
+    snprintf(cache->cpu_id, sizeof(cache->cpu_id), "%s", cpu_id);
+    if (!path || !(f = fopen(path, "r")))
+    {
+        return;
     }
-    // exit(0);
-#endif
+    if (fscanf(f, "uhd-autotune 1 %63s", file_cpu) == 1 && !strcmp(file_cpu, cache->cpu_id))
+    {
+        while (cache->nb_entry < UHD_TUNE_MAX_ENTRIES &&
+               fscanf(f, "%31s %d %d %d %d", e.slot, &e.bit_depth, &e.width, &e.height, &e.choice) == 5)
+        {
+            cache->entry[cache->nb_entry++] = e;
+        }
+    }
+    fclose(f);
 }
 
-// START OF THE FUNCTION - QPEL_BI_HV
-#define BI_VECTOR1
-#define BI_VECTOR2
-
-static void FUNC(put_hevc_qpel_bi_hv)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                      int16_t *src2,
-                                      int height, intptr_t mx, intptr_t my, int width)
+// Writes the cache if it gained choices since it was loaded. Goes through a
+// temporary file so a concurrent reader never sees half a cache. Returns 0 on
+// success and -1 on failure or when path is NULL (a cache loaded without a
+// file has nowhere to go).
+static int uhd_tune_cache_save(UHDTuneCache *cache, const char *path)
 {
-    int x, y;
-    const int16_t *filter;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst; 
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    int16_t tmp_array[(MAX_PB_SIZE + QPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
+    char tmp[1024];
+    FILE *f;
+    int i;
 
-    int shift = 14 + 1 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    if (!path)
+    {
+        return -1;
+    }
+    if (!cache->dirty)
+    {
+        return 0;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (!(f = fopen(tmp, "w")))
+    {
+        return -1;
+    }
+    fprintf(f, "uhd-autotune 1 %s\n", cache->cpu_id);
+    for (i = 0; i < cache->nb_entry; i++)
+    {
+        const UHDTuneEntry *e = &cache->entry[i];
+
+        fprintf(f, "%s %d %d %d %d\n", e->slot, e->bit_depth, e->width, e->height, e->choice);
+    }
+    if (fclose(f) || rename(tmp, path))
+    {
+        remove(tmp);
+        return -1;
+    }
+    cache->dirty = 0;
+    return 0;
+}
 
-    src -= QPEL_EXTRA_BEFORE * srcstride;
+// Returns the fastest of nb_candidates for slot at width x height, from the
+// cache when it has a valid choice. Otherwise every candidate is run
+// UHD_TUNE_ROUNDS times (UHD_TUNE_REPS calls each time), the rounds taking the
+// candidates in turn so clock or thermal drift hits them all alike. The best
+// round of each candidate is compared.
+static int uhd_tune_pick(UHDTuneCache *cache, const char *slot, int bit_depth, int width, int height,
+                         int nb_candidates, UHDTuneRun run, void *opaque)
+{
+    uint64_t best[8];
+    UHDTuneEntry *e;
+    int i, c, r, choice = 0;
 
-#ifdef BI_SCALAR1
-    filter = qpel_filter_size8[mx - 1];
-    for (y = 0; y < height + QPEL_EXTRA; y++)
+    for (i = 0; i < cache->nb_entry; i++)
     {
-        for (x = 0; x < width; x++)
+        e = &cache->entry[i];
+        if (!strcmp(e->slot, slot) && e->bit_depth == bit_depth && e->width == width && e->height == height &&
+            e->choice >= 0 && e->choice < nb_candidates)
         {
-            tmp[x] = QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            return e->choice;
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
-    }
-#endif
-
-#ifdef BI_VECTOR1
-    int shifts = BIT_DEPTH - 8;
-    int yval = height + QPEL_EXTRA;
-    filter = qpel_filter_size8[mx - 1];
-
-    #if BIT_DEPTH > 8
-            int16x4_t fil0 = vdup_n_s16(filter[0]);
-            int16x4_t fil1 = vdup_n_s16(filter[1]);
-            int16x4_t fil2 = vdup_n_s16(filter[2]);
-            int16x4_t fil3 = vdup_n_s16(filter[3]);
-            int16x4_t fil4 = vdup_n_s16(filter[4]);
-            int16x4_t fil5 = vdup_n_s16(filter[5]);
-            int16x4_t fil6 = vdup_n_s16(filter[6]);
-            int16x4_t fil7 = vdup_n_s16(filter[7]);
-    #else
-            int16x8_t fil0 = vdupq_n_s16(filter[0]);
-            int16x8_t fil1 = vdupq_n_s16(filter[1]);
-            int16x8_t fil2 = vdupq_n_s16(filter[2]);
-            int16x8_t fil3 = vdupq_n_s16(filter[3]);
-            int16x8_t fil4 = vdupq_n_s16(filter[4]);
-            int16x8_t fil5 = vdupq_n_s16(filter[5]);
-            int16x8_t fil6 = vdupq_n_s16(filter[6]);
-            int16x8_t fil7 = vdupq_n_s16(filter[7]);
-    #endif
-
-    for (y = 0; y < yval; y++)
+    }
+    if (nb_candidates > 8)
     {
-        for (x = 0; x < width; x += 8)
-        {
-           
-
-        #if BIT_DEPTH > 8
-            int32x4_t final1 = vdupq_n_s32(0);
-            int32x4_t final2 = vdupq_n_s32(0);
-
-            uint16_t *ptr;
-            ptr = src + x;
-            int16x4_t src0 = vreinterpret_s16_u16(vld1_u16(ptr - 3));
-            int16x4_t src1 = vreinterpret_s16_u16(vld1_u16(ptr + 1));
-
-            int16x4_t Src2 = vreinterpret_s16_u16(vld1_u16(ptr - 2));
-            int16x4_t src3 = vreinterpret_s16_u16(vld1_u16(ptr + 2));
-
-            int16x4_t src4 = vreinterpret_s16_u16(vld1_u16(ptr - 1));
-            int16x4_t src5 = vreinterpret_s16_u16(vld1_u16(ptr + 3));
-
-            int16x4_t src6 = vreinterpret_s16_u16(vld1_u16(ptr));
-            int16x4_t src7 = vreinterpret_s16_u16(vld1_u16(ptr + 4));
-
-            int16x4_t src8 = vreinterpret_s16_u16(vld1_u16(ptr + 1));
-            int16x4_t src9 = vreinterpret_s16_u16(vld1_u16(ptr + 5));
-
-            int16x4_t src10 = vreinterpret_s16_u16(vld1_u16(ptr + 2));
-            int16x4_t src11 = vreinterpret_s16_u16(vld1_u16(ptr + 6));
-
-            int16x4_t src12 = vreinterpret_s16_u16(vld1_u16(ptr + 3));
-            int16x4_t src13 = vreinterpret_s16_u16(vld1_u16(ptr + 7));
-
-            int16x4_t src14 = vreinterpret_s16_u16(vld1_u16(ptr + 4));
-            int16x4_t src15 = vreinterpret_s16_u16(vld1_u16(ptr + 8));
-
-
-            final1 = vmlal_s16(final1, src0 , fil0);
-            final2 = vmlal_s16(final2, src1 , fil0);
-
-            final1 = vmlal_s16(final1, Src2 , fil1);
-            final2 = vmlal_s16(final2, src3 , fil1);
-
-            final1 = vmlal_s16(final1, src4 , fil2);
-            final2 = vmlal_s16(final2, src5 , fil2);
-
-            final1 = vmlal_s16(final1, src6 , fil3);
-            final2 = vmlal_s16(final2, src7 , fil3);
-
-            final1 = vmlal_s16(final1, src8 , fil4);
-            final2 = vmlal_s16(final2, src9 , fil4);
+        nb_candidates = 8;
+    }
 
-            final1 = vmlal_s16(final1, src10 , fil5);
-            final2 = vmlal_s16(final2, src11 , fil5);
+    for (c = 0; c < nb_candidates; c++)
+    {
+        run(opaque, c, width, height); // warm the caches and branch predictors
+        best[c] = UINT64_MAX;
+    }
+    for (r = 0; r < UHD_TUNE_ROUNDS; r++)
+    {
+        for (c = 0; c < nb_candidates; c++)
+        {
+            uint64_t start = uhd_ticks();
 
-            final1 = vmlal_s16(final1, src12 , fil6);
-            final2 = vmlal_s16(final2, src13 , fil6);
+            for (i = 0; i < UHD_TUNE_REPS; i++)
+            {
+                run(opaque, c, width, height);
+            }
+            start = uhd_ticks() - start;
+            if (start < best[c])
+            {
+                best[c] = start;
+            }
+        }
+    }
+    for (c = 1; c < nb_candidates; c++)
+    {
+        if (best[c] < best[choice])
+        {
+            choice = c;
+        }
+    }
 
-            final1 = vmlal_s16(final1, src14 , fil7);
-            final2 = vmlal_s16(final2, src15 , fil7);
+    if (cache->nb_entry < UHD_TUNE_MAX_ENTRIES)
+    {
+        e = &cache->entry[cache->nb_entry++];
+        snprintf(e->slot, sizeof(e->slot), "%s", slot);
+        e->bit_depth = bit_depth;
+        e->width = width;
+        e->height = height;
+        e->choice = choice;
+        cache->dirty = 1;
+    }
+    return choice;
+}
 
-            final1 = vshrq_n_s32(final1, shifts);
-            final2 = vshrq_n_s32(final2, shifts);
+typedef void (*UHDQpelPutFn)(int16_t *dst, uint8_t *_src, ptrdiff_t _srcstride,
+                             int height, intptr_t mx, intptr_t my, int width);
+typedef int (*UHDCostFn)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *ref, ptrdiff_t refstride,
+                         int width, int height);
+typedef void (*UHDCostXnFn)(const uint8_t *src, ptrdiff_t srcstride, const uint8_t *const *ref,
+                            ptrdiff_t refstride, int width, int height, int *cost);
+typedef void (*UHDDequantFn)(int16_t *coeffs, int qp, const uint8_t *sm, int sm_dc);
+typedef void (*UHDIdctDequantFn)(int16_t *coeffs, int col_limit, int qp, const uint8_t *sm, int sm_dc);
+typedef void (*UHDFdctFn)(int16_t *coeffs);
+
+// Luma block widths, in the order of the dispatch tables' width index, and the
+// PU heights each occurs with (square, 2NxN/Nx2N and AMP partitions). A width
+// slot is timed over all of its heights, height 0 in the cache.
+#define UHD_TUNE_NB_WIDTHS 8
+static const int uhd_tune_widths[UHD_TUNE_NB_WIDTHS] = {4, 8, 12, 16, 24, 32, 48, 64};
+static const int8_t uhd_tune_heights[UHD_TUNE_NB_WIDTHS][7] = {
+    {8, 16}, {4, 8, 16, 32}, {16}, {4, 8, 12, 16, 32, 64}, {32}, {8, 16, 24, 32, 64}, {64}, {16, 32, 48, 64},
+};
+
+// The qpel table is indexed by fraction class: 0 integer, 1 quarter (1 or 3)
+// and 2 half. The half-pel kernels use the paired symmetric filter, so they
+// are timed apart from the quarter-pel ones, each class at its own fraction.
+#define UHD_TUNE_NB_FRAC 3
+static inline int uhd_tune_frac_class(intptr_t frac)
+{
+    return frac ? 2 - (frac & 1) : 0;
+}
 
-            int16x4_t intt1 = vmovn_s32(final1);
-            int16x4_t intt2 = vmovn_s32(final2);
+typedef struct UHDQpelTune
+{
+    const UHDQpelPutFn *fn;
+    const int8_t *heights;
+    int16_t *dst;
+    uint8_t *src;
+    ptrdiff_t srcstride;
+    intptr_t mx;
+    intptr_t my;
+} UHDQpelTune;
+
+static void uhd_tune_run_qpel(void *opaque, int candidate, int width, int height)
+{
+    UHDQpelTune *t = (UHDQpelTune *)opaque;
+    const int8_t *h;
 
-            vst1_s16(tmp + x, intt1);
-            vst1_s16(tmp + x + 4, intt2);
+    for (h = t->heights; *h; h++)
+    {
+        t->fn[candidate](t->dst, t->src, t->srcstride, *h, t->mx, t->my, width);
+    }
+}
 
-        #else
-            int16x8_t final = vdupq_n_s16(0);
-            uint8_t *ptr;
-            ptr = src + x;
-            int16x8_t src0 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 3)));
-            int16x8_t src1 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 2)));
-            int16x8_t Src2 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr - 1)));
-            int16x8_t src3 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr)));
-            int16x8_t src4 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 1)));
-            int16x8_t src5 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 2)));
-            int16x8_t src6 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 3)));
-            int16x8_t src7 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(ptr + 4)));
+typedef struct UHDCostTune
+{
+    const UHDCostFn *fn;
+    const UHDCostXnFn *fn_xn;
+    const int8_t *heights;
+    const uint8_t *src;
+    const uint8_t *ref[4];
+    ptrdiff_t stride;
+    unsigned sink; // keeps the costs alive
+} UHDCostTune;
+
+static void uhd_tune_run_cost(void *opaque, int candidate, int width, int height)
+{
+    UHDCostTune *t = (UHDCostTune *)opaque;
+    const int8_t *h;
+    int cost[4] = {0};
 
-            final = vmlaq_s16(final, src0, fil0);
-            final = vmlaq_s16(final, src1, fil1);
-            final = vmlaq_s16(final, Src2, fil2);
-            final = vmlaq_s16(final, src3, fil3);
-            final = vmlaq_s16(final, src4, fil4);
-            final = vmlaq_s16(final, src5, fil5);
-            final = vmlaq_s16(final, src6, fil6);
-            final = vmlaq_s16(final, src7, fil7);
-            final = vshrq_n_s16(final, shift);
-            vst1q_s16(tmp + x, final);
-    #endif
+    for (h = t->heights; *h; h++)
+    {
+        if (t->fn)
+        {
+            cost[0] += t->fn[candidate](t->src, t->stride, t->ref[0], t->stride, width, *h);
+        }
+        else
+        {
+            t->fn_xn[candidate](t->src, t->stride, t->ref, t->stride, width, *h, cost);
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
     }
-#endif
+    t->sink += (unsigned)cost[0] + (unsigned)cost[3];
+}
 
-#ifdef BI_SCALAR2
-    tmp = tmp_array + QPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_qpel_filters[my - 1];
-    for (y = 0; y < height; y++)
+// One TU size at a time. Every call starts from the same levels (or
+// residual), so repeated runs neither saturate nor decay to zero. Dequant and
+// idct_dequant run with the flat and the scaling list, idct_dequant at the
+// full and the 4-column col_limit.
+typedef struct UHDTransformTune
+{
+    const UHDDequantFn *dequant;
+    const UHDIdctDequantFn *idct_dequant;
+    const UHDFdctFn *fdct;
+    int16_t *coeffs;
+    const int16_t *levels;
+    const uint8_t *sm;
+} UHDTransformTune;
+
+static void uhd_tune_run_transform(void *opaque, int candidate, int width, int height)
+{
+    UHDTransformTune *t = (UHDTransformTune *)opaque;
+    size_t size = width * height * sizeof(int16_t);
+    int i;
+
+    for (i = 0; i < 2; i++)
     {
-        for (x = 0; x < width; x++)
+        memcpy(t->coeffs, t->levels, size);
+        if (t->dequant)
         {
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) + src2[x] + offset) >> shift);
+            t->dequant[candidate](t->coeffs, 22, i ? t->sm : NULL, 16);
+        }
+        else if (t->idct_dequant)
+        {
+            t->idct_dequant[candidate](t->coeffs, i ? 4 : width, 22, i ? t->sm : NULL, 16);
+        }
+        else
+        {
+            t->fdct[candidate](t->coeffs);
         }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
     }
+}
 #endif
 
-#ifdef BI_VECTOR2
-    int16_t *str;
-    tmp = tmp_array + 192;
-    filter = qpel_filter_size8[my - 1];
-
-    int16x8_t offvector = vdupq_n_s16(offset);
-    int32x4_t max = vdupq_n_s32((1 << BIT_DEPTH) - 1);
-    int32x4_t min = vdupq_n_s32(0);
-
-    int16x4_t filt0 = vdup_n_s16(filter[0]);
-    int16x4_t filt1 = vdup_n_s16(filter[1]);
-    int16x4_t filt2 = vdup_n_s16(filter[2]);
-    int16x4_t filt3 = vdup_n_s16(filter[3]);
-    int16x4_t filt4 = vdup_n_s16(filter[4]);
-    int16x4_t filt5 = vdup_n_s16(filter[5]);
-    int16x4_t filt6 = vdup_n_s16(filter[6]);
-    int16x4_t filt7 = vdup_n_s16(filter[7]);
+// The generic 14-bit qpel prediction, one qpel_bipred_row per row: table-driven
+// filters and an int32 vertical pass. This is the auto-tuner's alternative to
+// the fraction-specialized h/v kernels and the int16 hv kernel.
+static void FUNC(put_hevc_qpel_rows)(int16_t *dst, uint8_t *_src, ptrdiff_t _srcstride,
+                                     int height, intptr_t mx, intptr_t my, int width)
+{
+    pixel *src = (pixel *)_src;
+    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
+    int16_t ring[QPEL_RING_ROWS * MAX_PB_SIZE];
+    int y;
 
     for (y = 0; y < height; y++)
     {
-        for (x = 0; x < width; x += 8)
-        {
-            str = tmp + x;
-            int32x4_t final1 = vdupq_n_s32(0);
-            int32x4_t final2 = vdupq_n_s32(0);
-
-            int16x4_t src0 = vld1_s16(str - 192);
-            int16x4_t src1 = vld1_s16(str - 188);
-
-            int16x4_t Src2 = vld1_s16(str - 128);
-            int16x4_t src3 = vld1_s16(str - 124);
-
-            int16x4_t src4 = vld1_s16(str - 64);
-            int16x4_t src5 = vld1_s16(str - 60);
-
-            int16x4_t src6 = vld1_s16(str);
-            int16x4_t src7 = vld1_s16(str + 4);
-
-            int16x4_t src8 = vld1_s16(str + 64);
-            int16x4_t src9 = vld1_s16(str + 68);
+        FUNC(qpel_bipred_row)(dst, src, srcstride, ring, y, mx, my, width);
+        dst += MAX_PB_SIZE;
+    }
+}
 
-            int16x4_t src10 = vld1_s16(str + 128);
-            int16x4_t src11 = vld1_s16(str + 132);
+// dequant_NxN then idct_NxN behind the fused kernel's signature: the
+// auto-tuner's alternative to idct_dequant_NxN, which dequantizes with scalar
+// code inside the first pass where this runs the vector dequant on its own.
+#define IDCT_DEQUANT_SPLIT(H)                                                                 \
+    static void FUNC(idct_dequant_split_##H##x##H)(int16_t * coeffs, int col_limit, int qp,   \
+                                                   const uint8_t *sm, int sm_dc)              \
+    {                                                                                         \
+        FUNC(dequant_##H##x##H)(coeffs, qp, sm, sm_dc);                                       \
+        FUNC(idct_##H##x##H)(coeffs, col_limit);                                              \
+    }
 
-            int16x4_t src12 = vld1_s16(str + 192);
-            int16x4_t src13 = vld1_s16(str + 196);
+IDCT_DEQUANT_SPLIT(4)
+IDCT_DEQUANT_SPLIT(8)
+IDCT_DEQUANT_SPLIT(16)
+IDCT_DEQUANT_SPLIT(32)
+
+#undef IDCT_DEQUANT_SPLIT
+
+// Fills fn[width index][uhd_tune_frac_class(my)][uhd_tune_frac_class(mx)] with
+// the faster of the specialized put_hevc_qpel_{h,v,hv} and put_hevc_qpel_rows.
+// Each width is timed over its PU heights, each class at fraction 1 or 2; the
+// slot name carries the fractions, e.g. put_hevc_qpel_hv_mx2_my1. Returns -1
+// if the bench buffers cannot be allocated, leaving the specialized kernels
+// in place.
+static int FUNC(uhd_autotune_qpel)(UHDTuneCache *cache,
+                                   UHDQpelPutFn fn[UHD_TUNE_NB_WIDTHS][UHD_TUNE_NB_FRAC][UHD_TUNE_NB_FRAC])
+{
+    static const char *const slot[3] = {"put_hevc_qpel_h", "put_hevc_qpel_v", "put_hevc_qpel_hv"};
+    const UHDQpelPutFn candidates[3][2] = {
+        {FUNC(put_hevc_qpel_h), FUNC(put_hevc_qpel_rows)},
+        {FUNC(put_hevc_qpel_v), FUNC(put_hevc_qpel_rows)},
+        {FUNC(put_hevc_qpel_hv), FUNC(put_hevc_qpel_rows)},
+    };
+    // 64 rows plus the filter margins, with room for the 8-lane overreads
+    const ptrdiff_t srcstride = MAX_PB_SIZE + 2 * 16;
+    const int src_rows = MAX_PB_SIZE + 2 * 8;
+    pixel *src = (pixel *)malloc(srcstride * src_rows * sizeof(pixel));
+    int16_t *dst = (int16_t *)malloc(MAX_PB_SIZE * MAX_PB_SIZE * sizeof(int16_t));
+    UHDQpelTune t;
+    char name[32];
+    int i, cx, cy;
+
+    for (i = 0; i < UHD_TUNE_NB_WIDTHS; i++)
+    {
+        for (cy = 0; cy < UHD_TUNE_NB_FRAC; cy++)
+        {
+            for (cx = 0; cx < UHD_TUNE_NB_FRAC; cx++)
+            {
+                fn[i][cy][cx] = !cx && !cy ? FUNC(put_hevc_pel_pixels) : candidates[2 * !!cy + !!cx - 1][0];
+            }
+        }
+    }
+    if (!src || !dst)
+    {
+        free(src);
+        free(dst);
+        return -1;
+    }
+    for (i = 0; i < srcstride * src_rows; i++)
+    {
+        src[i] = (i * 97 + (i >> 5) * 31) & ((1 << BIT_DEPTH) - 1);
+    }
 
-            int16x4_t src14 = vld1_s16(str + 256);
-            int16x4_t src15 = vld1_s16(str + 260);
+    t.dst = dst;
+    t.src = (uint8_t *)(src + 8 * srcstride + 16);
+    t.srcstride = srcstride * sizeof(pixel);
+    for (cy = 0; cy < UHD_TUNE_NB_FRAC; cy++)
+    {
+        for (cx = !cy; cx < UHD_TUNE_NB_FRAC; cx++)
+        {
+            int k = 2 * !!cy + !!cx - 1;
 
-            final1 = vmlal_s16(final1, src0, filt0);
-            final2 = vmlal_s16(final2, src1, filt0);
+            t.fn = candidates[k];
+            t.mx = cx;
+            t.my = cy;
+            if (!cy)
+            {
+                snprintf(name, sizeof(name), "%s_mx%d", slot[k], cx);
+            }
+            else if (!cx)
+            {
+                snprintf(name, sizeof(name), "%s_my%d", slot[k], cy);
+            }
+            else
+            {
+                snprintf(name, sizeof(name), "%s_mx%d_my%d", slot[k], cx, cy);
+            }
+            for (i = 0; i < UHD_TUNE_NB_WIDTHS; i++)
+            {
+                t.heights = uhd_tune_heights[i];
+                fn[i][cy][cx] = candidates[k][uhd_tune_pick(cache, name, BIT_DEPTH, uhd_tune_widths[i], 0, 2,
+                                                            uhd_tune_run_qpel, &t)];
+            }
+        }
+    }
 
-            final1 = vmlal_s16(final1, Src2, filt1);
-            final2 = vmlal_s16(final2, src3, filt1);
+    free(src);
+    free(dst);
+    return 0;
+}
 
-            final1 = vmlal_s16(final1, src4, filt2);
-            final2 = vmlal_s16(final2, src5, filt2);
+// Fills the per-width block cost slots with the faster of the vector kernels
+// and the scalar _c references, each width timed over its PU heights. Returns
+// -1 if the bench buffers cannot be allocated, leaving the vector kernels in
+// place.
+static int FUNC(uhd_autotune_cost)(UHDTuneCache *cache, UHDCostFn sad[UHD_TUNE_NB_WIDTHS],
+                                   UHDCostFn satd[UHD_TUNE_NB_WIDTHS], UHDCostXnFn sad_x3[UHD_TUNE_NB_WIDTHS],
+                                   UHDCostXnFn sad_x4[UHD_TUNE_NB_WIDTHS])
+{
+    const UHDCostFn sad_candidates[2] = {FUNC(pixel_sad), FUNC(pixel_sad_c)};
+    const UHDCostFn satd_candidates[2] = {FUNC(pixel_satd), FUNC(pixel_satd_c)};
+    const UHDCostXnFn sad_x3_candidates[2] = {FUNC(pixel_sad_x3), FUNC(pixel_sad_x3_c)};
+    const UHDCostXnFn sad_x4_candidates[2] = {FUNC(pixel_sad_x4), FUNC(pixel_sad_x4_c)};
+    // the source block and four references a few pixels apart in one plane
+    const ptrdiff_t stride = MAX_PB_SIZE + 16;
+    const int rows = 2 * MAX_PB_SIZE + 8;
+    pixel *buf = (pixel *)malloc(stride * rows * sizeof(pixel));
+    UHDCostTune t;
+    int i, k;
+
+    for (i = 0; i < UHD_TUNE_NB_WIDTHS; i++)
+    {
+        sad[i] = sad_candidates[0];
+        satd[i] = satd_candidates[0];
+        sad_x3[i] = sad_x3_candidates[0];
+        sad_x4[i] = sad_x4_candidates[0];
+    }
+    if (!buf)
+    {
+        return -1;
+    }
+    for (i = 0; i < stride * rows; i++)
+    {
+        buf[i] = (i * 97 + (i >> 5) * 31) & ((1 << BIT_DEPTH) - 1);
+    }
 
-            final1 = vmlal_s16(final1, src6, filt3);
-            final2 = vmlal_s16(final2, src7, filt3);
+    memset(&t, 0, sizeof(t));
+    t.src = (const uint8_t *)(buf + (MAX_PB_SIZE + 8) * stride);
+    for (k = 0; k < 4; k++)
+    {
+        t.ref[k] = (const uint8_t *)(buf + k * stride + 3 * k);
+    }
+    t.stride = stride * sizeof(pixel);
+    for (i = 0; i < UHD_TUNE_NB_WIDTHS; i++)
+    {
+        int w = uhd_tune_widths[i];
+
+        t.heights = uhd_tune_heights[i];
+        t.fn_xn = NULL;
+        t.fn = sad_candidates;
+        sad[i] = sad_candidates[uhd_tune_pick(cache, "pixel_sad", BIT_DEPTH, w, 0, 2, uhd_tune_run_cost, &t)];
+        t.fn = satd_candidates;
+        satd[i] = satd_candidates[uhd_tune_pick(cache, "pixel_satd", BIT_DEPTH, w, 0, 2, uhd_tune_run_cost, &t)];
+        t.fn = NULL;
+        t.fn_xn = sad_x3_candidates;
+        sad_x3[i] = sad_x3_candidates[uhd_tune_pick(cache, "pixel_sad_x3", BIT_DEPTH, w, 0, 2,
+                                                    uhd_tune_run_cost, &t)];
+        t.fn_xn = sad_x4_candidates;
+        sad_x4[i] = sad_x4_candidates[uhd_tune_pick(cache, "pixel_sad_x4", BIT_DEPTH, w, 0, 2,
+                                                    uhd_tune_run_cost, &t)];
+    }
 
-            final1 = vmlal_s16(final1, src8, filt4);
-            final2 = vmlal_s16(final2, src9, filt4);
+    free(buf);
+    return 0;
+}
 
-            final1 = vmlal_s16(final1, src10, filt5);
-            final2 = vmlal_s16(final2, src11, filt5);
+// Fills the per-TU-size slots (4x4 to 32x32): dequant with dequant_NxN or the
+// scalar dequant_NxN_c, idct_dequant with the fused kernel or
+// idct_dequant_split_NxN, fdct with the vector fdct_NxN or the scalar
+// fdct_NxN_c, and *fdst with fdst_4x4 or fdst_4x4_c. Which of the vector and
+// scalar bodies fdct_NxN and dequant_NxN hold is still set by VECTOR_FDCT and
+// VECTOR_DEQUANT.
+static void FUNC(uhd_autotune_transform)(UHDTuneCache *cache, UHDDequantFn dequant[4],
+                                         UHDIdctDequantFn idct_dequant[4], UHDFdctFn fdct[4], UHDFdctFn *fdst)
+{
+    const UHDDequantFn dequant_candidates[4][2] = {
+        {FUNC(dequant_4x4), FUNC(dequant_4x4_c)},
+        {FUNC(dequant_8x8), FUNC(dequant_8x8_c)},
+        {FUNC(dequant_16x16), FUNC(dequant_16x16_c)},
+        {FUNC(dequant_32x32), FUNC(dequant_32x32_c)},
+    };
+    const UHDIdctDequantFn idct_dequant_candidates[4][2] = {
+        {FUNC(idct_dequant_4x4), FUNC(idct_dequant_split_4x4)},
+        {FUNC(idct_dequant_8x8), FUNC(idct_dequant_split_8x8)},
+        {FUNC(idct_dequant_16x16), FUNC(idct_dequant_split_16x16)},
+        {FUNC(idct_dequant_32x32), FUNC(idct_dequant_split_32x32)},
+    };
+    const UHDFdctFn fdct_candidates[4][2] = {
+        {FUNC(fdct_4x4), FUNC(fdct_4x4_c)},
+        {FUNC(fdct_8x8), FUNC(fdct_8x8_c)},
+        {FUNC(fdct_16x16), FUNC(fdct_16x16_c)},
+        {FUNC(fdct_32x32), FUNC(fdct_32x32_c)},
+    };
+    const UHDFdctFn fdst_candidates[2] = {FUNC(fdst_4x4), FUNC(fdst_4x4_c)};
+    int16_t coeffs[32 * 32];
+    int16_t levels[32 * 32];
+    int16_t residual[32 * 32];
+    uint8_t sm[64];
+    UHDTransformTune t;
+    int i, size;
+
+    for (i = 0; i < 32 * 32; i++)
+    {
+        levels[i] = (i * 37 % 11) - 5;
+        residual[i] = ((i * 97 + (i >> 5) * 31) & ((1 << BIT_DEPTH) - 1)) - (1 << (BIT_DEPTH - 1));
+    }
+    for (i = 0; i < 64; i++)
+    {
+        sm[i] = 16 + (i & 7) + (i >> 3);
+    }
 
-            final1 = vmlal_s16(final1, src12, filt6);
-            final2 = vmlal_s16(final2, src13, filt6);
+    memset(&t, 0, sizeof(t));
+    t.coeffs = coeffs;
+    t.sm = sm;
+    for (i = 0; i < 4; i++)
+    {
+        size = 4 << i;
+        t.levels = levels;
+        t.fdct = NULL;
+        t.idct_dequant = NULL;
+        t.dequant = dequant_candidates[i];
+        dequant[i] = dequant_candidates[i][uhd_tune_pick(cache, "dequant", BIT_DEPTH, size, size, 2,
+                                                         uhd_tune_run_transform, &t)];
+        t.dequant = NULL;
+        t.idct_dequant = idct_dequant_candidates[i];
+        idct_dequant[i] = idct_dequant_candidates[i][uhd_tune_pick(cache, "idct_dequant", BIT_DEPTH, size, size,
+                                                                   2, uhd_tune_run_transform, &t)];
+        t.idct_dequant = NULL;
+        t.levels = residual;
+        t.fdct = fdct_candidates[i];
+        fdct[i] = fdct_candidates[i][uhd_tune_pick(cache, "fdct", BIT_DEPTH, size, size, 2,
+                                                   uhd_tune_run_transform, &t)];
+    }
+    t.fdct = fdst_candidates;
+    *fdst = fdst_candidates[uhd_tune_pick(cache, "fdst", BIT_DEPTH, 4, 4, 2, uhd_tune_run_transform, &t)];
+}
 
-            final1 = vmlal_s16(final1, src14, filt7);
-            final2 = vmlal_s16(final2, src15, filt7);
+////////////////////////////////////////////////////////////////////////////////
+// Call tracing (build with UHD_KERNEL_TRACE). The dispatch table points at the
+// name_trace wrappers below. Between uhd_trace_start and uhd_trace_stop each
+// call is appended to a binary trace as a UHDTraceRecord (kernel, bit depth,
+// size, fraction, strides, buffer offsets). uhd_trace_replay re-runs a trace
+// on synthetic buffers, so a kernel change can be timed on real call
+// sequences without the decoder. Pointers are stored as offsets into the
+// frame buffers registered with uhd_trace_buffer. Calls on other memory (edge
+// emulation or SAO scratch) replay on a scratch block. Records are native
+// endian.
+////////////////////////////////////////////////////////////////////////////////
+#ifdef UHD_KERNEL_TRACE
+#ifndef UHD_KERNEL_TRACE_STATE
+#define UHD_KERNEL_TRACE_STATE
+#include <stdio.h>
+
+// every traced kernel with its signature family
+#define UHD_TRACE_KERNELS(X)                                             \
+    X(PUT, put_hevc_pel_pixels)                                          \
+    X(UNI, put_hevc_pel_uni_pixels)                                      \
+    X(BI, put_hevc_pel_bi_pixels)                                        \
+    X(UNI_W, put_hevc_pel_uni_w_pixels)                                  \
+    X(BI_W, put_hevc_pel_bi_w_pixels)                                    \
+    X(PUT, put_hevc_qpel_h) X(PUT, put_hevc_qpel_v) X(PUT, put_hevc_qpel_hv) \
+    X(UNI, put_hevc_qpel_uni_h) X(UNI, put_hevc_qpel_uni_v) X(UNI, put_hevc_qpel_uni_hv) \
+    X(BI, put_hevc_qpel_bi_h) X(BI, put_hevc_qpel_bi_v) X(BI, put_hevc_qpel_bi_hv) \
+    X(UNI_W, put_hevc_qpel_uni_w_h) X(UNI_W, put_hevc_qpel_uni_w_v) X(UNI_W, put_hevc_qpel_uni_w_hv) \
+    X(BI_W, put_hevc_qpel_bi_w_h) X(BI_W, put_hevc_qpel_bi_w_v) X(BI_W, put_hevc_qpel_bi_w_hv) \
+    X(PUT, put_hevc_epel_h) X(PUT, put_hevc_epel_v) X(PUT, put_hevc_epel_hv) \
+    X(UNI, put_hevc_epel_uni_h) X(UNI, put_hevc_epel_uni_v) X(UNI, put_hevc_epel_uni_hv) \
+    X(BI, put_hevc_epel_bi_h) X(BI, put_hevc_epel_bi_v) X(BI, put_hevc_epel_bi_hv) \
+    X(UNI_W, put_hevc_epel_uni_w_h) X(UNI_W, put_hevc_epel_uni_w_v) X(UNI_W, put_hevc_epel_uni_w_hv) \
+    X(BI_W, put_hevc_epel_bi_w_h) X(BI_W, put_hevc_epel_bi_w_v) X(BI_W, put_hevc_epel_bi_w_hv) \
+    X(SAO_BAND, sao_band_filter)                                         \
+    X(SAO_EDGE, sao_edge_filter)
+
+#define UHD_TRACE_ID(kind, name) UHD_TRACE_##name,
+enum
+{
+    UHD_TRACE_KERNELS(UHD_TRACE_ID)
+    UHD_TRACE_NB
+};
+#undef UHD_TRACE_ID
 
-            int16x4_t f_sum0 = vshrn_n_s32(final1, 6);
-            int16x4_t f_sum1 = vshrn_n_s32(final2, 6);
+#define UHD_TRACE_MAGIC "UHDTRC1\n"
+#define UHD_TRACE_BUFFER 255  // record that registers frame buffer dst_buf of dst_offset bytes
+#define UHD_TRACE_NB_BUF 64   // also the buffer index of unregistered memory
+#define UHD_TRACE_FLUSH 1024
 
-            int16x8_t combined = vcombine_s16(f_sum0, f_sum1);
+typedef struct UHDTraceRecord
+{
+    uint8_t kernel;
+    uint8_t bit_depth;
+    uint8_t width;
+    uint8_t height;
+    int8_t mx; // SAO band position or edge class for SAO
+    int8_t my;
+    uint8_t dst_buf;
+    uint8_t src_buf;
+    uint32_t dst_offset;
+    uint32_t src_offset;
+    int32_t dststride; // in bytes
+    int32_t srcstride;
+} UHDTraceRecord;
+
+typedef struct UHDTraceState
+{
+    FILE *f;
+    const uint8_t *base[UHD_TRACE_NB_BUF];
+    size_t size[UHD_TRACE_NB_BUF];
+    UHDTraceRecord rec[UHD_TRACE_FLUSH];
+    int nb_rec;
+} UHDTraceState;
 
-            int16x8_t srcvector = vld1q_s16(src2 + x);
+static UHDTraceState *uhd_trace_state;
+static int uhd_trace_lock;
 
-            int16x8_t result1 = vaddq_s16(combined, offvector);
+static inline void uhd_trace_acquire(void)
+{
+    while (__atomic_exchange_n(&uhd_trace_lock, 1, __ATOMIC_ACQUIRE))
+        ;
+}
 
-            int32x4_t result2 = vaddl_s16(vget_low_s16(result1), vget_low_s16(srcvector));
-            int32x4_t result3 = vaddl_s16(vget_high_s16(result1), vget_high_s16(srcvector));
+static inline void uhd_trace_release(void)
+{
+    __atomic_store_n(&uhd_trace_lock, 0, __ATOMIC_RELEASE);
+}
 
-            result2 = vshrq_n_s32(result2, shift);
-            result3 = vshrq_n_s32(result3, shift);
+// appends r, writing the batch out when it is full; called with the lock held
+static void uhd_trace_put(UHDTraceState *s, const UHDTraceRecord *r)
+{
+    s->rec[s->nb_rec++] = *r;
+    if (s->nb_rec == UHD_TRACE_FLUSH)
+    {
+        fwrite(s->rec, sizeof(*r), s->nb_rec, s->f);
+        s->nb_rec = 0;
+    }
+}
 
-            uint16x4_t clip0 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, result2))));
-            uint16x4_t clip1 = vreinterpret_u16_s16(vmovn_s32(vminq_s32(max, vmaxq_s32(min, result3))));
+// Starts recording to path. Returns 0 on success.
+static int uhd_trace_start(const char *path)
+{
+    UHDTraceState *s = (UHDTraceState *)calloc(1, sizeof(*s));
 
-            uint16x8_t opp = vcombine_u16(clip0, clip1);
-            #if BIT_DEPTH > 8
-                vst1q_u16(dst + x, opp);
-            #else
-            uint8x8_t finale = vqmovn_u16(opp);
-            vst1_u8(dst + x, finale);
-            #endif
-        }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+    if (!s || !(s->f = fopen(path, "wb")))
+    {
+        free(s);
+        return -1;
     }
-#endif
+    fwrite(UHD_TRACE_MAGIC, 1, 8, s->f);
+    uhd_trace_acquire();
+    uhd_trace_state = s;
+    uhd_trace_release();
+    return 0;
 }
-// END OF QPEL_BI_HV
 
-static void FUNC(put_hevc_qpel_uni_w_h)(uint8_t *_dst, ptrdiff_t _dststride,
-                                        uint8_t *_src, ptrdiff_t _srcstride,
-                                        int height, int denom, int wx, int ox,
-                                        intptr_t mx, intptr_t my, int width)
+static void uhd_trace_stop(void)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_qpel_filters[mx - 1];
-    int shift = denom + 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    UHDTraceState *s;
 
-    ox = ox * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    uhd_trace_acquire();
+    s = uhd_trace_state;
+    uhd_trace_state = NULL;
+    uhd_trace_release();
+    if (s)
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = uhd_clip_pixel((((QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) * wx + offset) >> shift) + ox);
-        }
-        src += srcstride;
-        dst += dststride;
+        fwrite(s->rec, sizeof(s->rec[0]), s->nb_rec, s->f);
+        fclose(s->f);
+        free(s);
     }
 }
 
-static void FUNC(put_hevc_qpel_bi_w_h)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                       int16_t *src2,
-                                       int height, int denom, int wx0, int wx1,
-                                       int ox0, int ox1, intptr_t mx, intptr_t my, int width)
+// Registers (or with base NULL, drops) frame buffer id, normally one plane of a
+// DPB picture including its padding. Kernel pointers inside it are recorded
+// as offsets.
+static void uhd_trace_buffer(int id, const uint8_t *base, size_t size)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
+    UHDTraceRecord r;
 
-    const int8_t *filter = uhd_hevc_qpel_filters[mx - 1];
-
-    int shift = 14 + 1 - BIT_DEPTH;
-    int log2Wd = denom + shift - 1;
+    if (id < 0 || id >= UHD_TRACE_NB_BUF)
+    {
+        return;
+    }
+    memset(&r, 0, sizeof(r));
+    r.kernel = UHD_TRACE_BUFFER;
+    r.dst_buf = id;
+    r.dst_offset = base ? (uint32_t)size : 0;
 
-    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
-    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    uhd_trace_acquire();
+    if (uhd_trace_state)
     {
-        for (x = 0; x < width; x++)
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) * wx1 + src2[x] * wx0 +
-                                     ((ox0 + ox1 + 1) << log2Wd)) >>
-                                    (log2Wd + 1));
-        src += srcstride;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+        uhd_trace_state->base[id] = base;
+        uhd_trace_state->size[id] = base ? size : 0;
+        uhd_trace_put(uhd_trace_state, &r);
     }
+    uhd_trace_release();
 }
 
-static void FUNC(put_hevc_qpel_uni_w_v)(uint8_t *_dst, ptrdiff_t _dststride,
-                                        uint8_t *_src, ptrdiff_t _srcstride,
-                                        int height, int denom, int wx, int ox,
-                                        intptr_t mx, intptr_t my, int width)
+static void uhd_trace_locate(const UHDTraceState *s, const uint8_t *p, uint8_t *buf, uint32_t *offset)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
-    int shift = denom + 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    int i;
 
-    ox = ox * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    for (i = 0; i < UHD_TRACE_NB_BUF; i++)
     {
-        for (x = 0; x < width; x++)
+        if (s->base[i] && p >= s->base[i] && p < s->base[i] + s->size[i])
         {
-            dst[x] = uhd_clip_pixel((((QPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) * wx + offset) >> shift) + ox);
+            *buf = i;
+            *offset = (uint32_t)(p - s->base[i]);
+            return;
         }
-        src += srcstride;
-        dst += dststride;
     }
+    *buf = UHD_TRACE_NB_BUF;
+    *offset = (uint32_t)((uintptr_t)p & 63); // keeps the alignment
 }
 
-static void FUNC(put_hevc_qpel_bi_w_v)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                       int16_t *src2,
-                                       int height, int denom, int wx0, int wx1,
-                                       int ox0, int ox1, intptr_t mx, intptr_t my, int width)
+static void uhd_trace_log(int kernel, int bit_depth, int width, int height, int mx, int my,
+                          const uint8_t *dst, ptrdiff_t dststride, const uint8_t *src, ptrdiff_t srcstride)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-
-    const int8_t *filter = uhd_hevc_qpel_filters[my - 1];
-
-    int shift = 14 + 1 - BIT_DEPTH;
-    int log2Wd = denom + shift - 1;
+    UHDTraceRecord r;
 
-    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
-    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    if (!__atomic_load_n(&uhd_trace_state, __ATOMIC_RELAXED))
     {
-        for (x = 0; x < width; x++)
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) * wx1 + src2[x] * wx0 +
-                                     ((ox0 + ox1 + 1) << log2Wd)) >>
-                                    (log2Wd + 1));
-        src += srcstride;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+        return;
     }
-}
-
-static void FUNC(put_hevc_qpel_uni_w_hv)(uint8_t *_dst, ptrdiff_t _dststride,
-                                         uint8_t *_src, ptrdiff_t _srcstride,
-                                         int height, int denom, int wx, int ox,
-                                         intptr_t mx, intptr_t my, int width)
-{
-    int x, y;
-    const int8_t *filter;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    int16_t tmp_array[(MAX_PB_SIZE + QPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    int shift = denom + 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    r.kernel = kernel;
+    r.bit_depth = bit_depth;
+    r.width = width;
+    r.height = height;
+    r.mx = mx;
+    r.my = my;
+    r.dststride = (int32_t)dststride;
+    r.srcstride = (int32_t)srcstride;
+
+    uhd_trace_acquire();
+    if (uhd_trace_state)
+    {
+        uhd_trace_locate(uhd_trace_state, dst, &r.dst_buf, &r.dst_offset);
+        uhd_trace_locate(uhd_trace_state, src, &r.src_buf, &r.src_offset);
+        uhd_trace_put(uhd_trace_state, &r);
+    }
+    uhd_trace_release();
+}
 
-    src -= QPEL_EXTRA_BEFORE * srcstride;
-    filter = uhd_hevc_qpel_filters[mx - 1];
-    for (y = 0; y < height + QPEL_EXTRA; y++)
+// Maps a recorded block to replay memory. The block plus the filter margins
+// must fit its buffer, otherwise NULL. Unregistered blocks get a scratch
+// area that grows as needed.
+static uint8_t *uhd_trace_resolve(uint8_t **buf, const size_t *size, uint8_t **scratch, size_t *scratch_size,
+                                  int id, uint32_t offset, ptrdiff_t stride, int height)
+{
+    size_t before, after;
+
+    if (stride <= 0)
     {
-        for (x = 0; x < width; x++)
+        return NULL;
+    }
+    before = 4 * stride + 64;
+    after = (height + 5) * stride;
+    if (id < UHD_TRACE_NB_BUF)
+    {
+        if (!buf[id] || offset < before || offset + after > size[id])
         {
-            tmp[x] = QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            return NULL;
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
+        return buf[id] + offset;
     }
-
-    tmp = tmp_array + QPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_qpel_filters[my - 1];
-
-    ox = ox * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    if (*scratch_size < before + after)
     {
-        for (x = 0; x < width; x++)
+        free(*scratch);
+        *scratch_size = 0;
+        if (!(*scratch = (uint8_t *)calloc(before + after, 1)))
         {
-            dst[x] = uhd_clip_pixel((((QPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) * wx + offset) >> shift) + ox);
+            return NULL;
         }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
+        *scratch_size = before + after;
     }
+    return *scratch + before;
 }
 
-static void FUNC(put_hevc_qpel_bi_w_hv)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                        int16_t *src2,
-                                        int height, int denom, int wx0, int wx1,
-                                        int ox0, int ox1, intptr_t mx, intptr_t my, int width)
+#define UHD_TRACE_SIG_PUT int16_t *dst, uint8_t *_src, ptrdiff_t _srcstride, int height, intptr_t mx, intptr_t my, int width
+#define UHD_TRACE_SIG_UNI uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride, \
+                          int height, intptr_t mx, intptr_t my, int width
+#define UHD_TRACE_SIG_BI uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride, \
+                         int16_t *src2, int height, intptr_t mx, intptr_t my, int width
+#define UHD_TRACE_SIG_UNI_W uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride, \
+                            int height, int denom, int wx, int ox, intptr_t mx, intptr_t my, int width
+#define UHD_TRACE_SIG_BI_W uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,        \
+                           int16_t *src2, int height, int denom, int wx0, int wx1, int ox0, int ox1, \
+                           intptr_t mx, intptr_t my, int width
+#define UHD_TRACE_SIG_SAO_BAND uint8_t *_dst, uint8_t *_src, ptrdiff_t _dststride, ptrdiff_t _srcstride, \
+                               int16_t *sao_offset_val, int mx, int width, int height
+#define UHD_TRACE_SIG_SAO_EDGE uint8_t *_dst, uint8_t *_src, ptrdiff_t _dststride, int16_t *sao_offset_val, \
+                               int mx, int width, int height
+
+#define UHD_TRACE_ARGS_PUT dst, _src, _srcstride, height, mx, my, width
+#define UHD_TRACE_ARGS_UNI _dst, _dststride, _src, _srcstride, height, mx, my, width
+#define UHD_TRACE_ARGS_BI _dst, _dststride, _src, _srcstride, src2, height, mx, my, width
+#define UHD_TRACE_ARGS_UNI_W _dst, _dststride, _src, _srcstride, height, denom, wx, ox, mx, my, width
+#define UHD_TRACE_ARGS_BI_W _dst, _dststride, _src, _srcstride, src2, height, denom, wx0, wx1, ox0, ox1, mx, my, width
+#define UHD_TRACE_ARGS_SAO_BAND _dst, _src, _dststride, _srcstride, sao_offset_val, mx, width, height
+#define UHD_TRACE_ARGS_SAO_EDGE _dst, _src, _dststride, sao_offset_val, mx, width, height
+
+// the 14-bit PUT output goes to an int16 MAX_PB_SIZE block, SAO edge reads its
+// fixed-stride CTB copy
+#define UHD_TRACE_DST_PUT NULL, MAX_PB_SIZE * sizeof(int16_t)
+#define UHD_TRACE_DST_UNI _dst, _dststride
+#define UHD_TRACE_DST_BI _dst, _dststride
+#define UHD_TRACE_DST_UNI_W _dst, _dststride
+#define UHD_TRACE_DST_BI_W _dst, _dststride
+#define UHD_TRACE_DST_SAO_BAND _dst, _dststride
+#define UHD_TRACE_DST_SAO_EDGE _dst, _dststride
+#define UHD_TRACE_SRCSTRIDE_PUT _srcstride
+#define UHD_TRACE_SRCSTRIDE_UNI _srcstride
+#define UHD_TRACE_SRCSTRIDE_BI _srcstride
+#define UHD_TRACE_SRCSTRIDE_UNI_W _srcstride
+#define UHD_TRACE_SRCSTRIDE_BI_W _srcstride
+#define UHD_TRACE_SRCSTRIDE_SAO_BAND _srcstride
+#define UHD_TRACE_SRCSTRIDE_SAO_EDGE (2 * MAX_PB_SIZE + UHD_INPUT_BUFFER_PADDING_SIZE)
+
+// Replay locals: dst/dststride/src/srcstride resolved from the record, tmp
+// as the int16 block, unit weights for the weighted kernels.
+#define UHD_TRACE_REPLAY_PUT tmp, src, srcstride, h, mx, my, w
+#define UHD_TRACE_REPLAY_UNI dst, dststride, src, srcstride, h, mx, my, w
+#define UHD_TRACE_REPLAY_BI dst, dststride, src, srcstride, tmp, h, mx, my, w
+#define UHD_TRACE_REPLAY_UNI_W dst, dststride, src, srcstride, h, 6, 64, 0, mx, my, w
+#define UHD_TRACE_REPLAY_BI_W dst, dststride, src, srcstride, tmp, h, 6, 64, 64, 0, 0, mx, my, w
+#define UHD_TRACE_REPLAY_SAO_BAND dst, src, dststride, srcstride, sao_offset, (int)mx, w, h
+#define UHD_TRACE_REPLAY_SAO_EDGE dst, src, dststride, sao_offset, (int)mx, w, h
+#endif
+
+#define PUT_TRACE(kind, name)                                                                           \
+    static void FUNC(name##_trace)(UHD_TRACE_SIG_##kind)                                                \
+    {                                                                                                   \
+        uhd_trace_log(UHD_TRACE_##name, BIT_DEPTH, width, height, (int)mx, (int)PUT_TRACE_MY_##kind,    \
+                      UHD_TRACE_DST_##kind, _src, UHD_TRACE_SRCSTRIDE_##kind);                          \
+        FUNC(name)(UHD_TRACE_ARGS_##kind);                                                              \
+    }
+#define PUT_TRACE_MY_PUT my
+#define PUT_TRACE_MY_UNI my
+#define PUT_TRACE_MY_BI my
+#define PUT_TRACE_MY_UNI_W my
+#define PUT_TRACE_MY_BI_W my
+#define PUT_TRACE_MY_SAO_BAND 0
+#define PUT_TRACE_MY_SAO_EDGE 0
+
+UHD_TRACE_KERNELS(PUT_TRACE)
+
+#define UHD_TRACE_CASE(kind, name)                   \
+    case UHD_TRACE_##name:                           \
+        FUNC(name)(UHD_TRACE_REPLAY_##kind);         \
+        break;
+
+// Replays the trace at path on synthetic buffers: each registered buffer is
+// allocated at its recorded size and filled with a pattern, and calls for
+// other bit depths or with blocks that do not fit are skipped. Returns the
+// number of calls run (their total time in *ticks), or -1 if path is not a
+// trace.
+static int FUNC(uhd_trace_replay)(const char *path, uint64_t *ticks)
 {
-    int x, y;
-    const int8_t *filter;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    int16_t tmp_array[(MAX_PB_SIZE + QPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    int shift = 14 + 1 - BIT_DEPTH;
-    int log2Wd = denom + shift - 1;
+    uint8_t *buf[UHD_TRACE_NB_BUF] = {0};
+    size_t size[UHD_TRACE_NB_BUF] = {0};
+    uint8_t *scratch[2] = {0};
+    size_t scratch_size[2] = {0};
+    int16_t tmp[MAX_PB_SIZE * MAX_PB_SIZE];
+    int16_t sao_offset[8] = {0, 2, 1, -1, -2};
+    uint64_t total = 0;
+    UHDTraceRecord r;
+    char magic[8];
+    int calls = 0;
+    size_t i;
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+    {
+        return -1;
+    }
+    if (fread(magic, 1, 8, f) != 8 || memcmp(magic, UHD_TRACE_MAGIC, 8))
+    {
+        fclose(f);
+        return -1;
+    }
+    memset(tmp, 0, sizeof(tmp));
 
-    src -= QPEL_EXTRA_BEFORE * srcstride;
-    filter = uhd_hevc_qpel_filters[mx - 1];
-    for (y = 0; y < height + QPEL_EXTRA; y++)
+    while (fread(&r, sizeof(r), 1, f) == 1)
     {
-        for (x = 0; x < width; x++)
+        uint8_t *dst, *src;
+        ptrdiff_t dststride = r.dststride, srcstride = r.srcstride;
+        int w = r.width, h = r.height;
+        intptr_t mx = r.mx, my = r.my;
+        uint64_t start;
+
+        if (r.kernel == UHD_TRACE_BUFFER)
         {
-            tmp[x] = QPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            if (r.dst_buf < UHD_TRACE_NB_BUF)
+            {
+                free(buf[r.dst_buf]);
+                size[r.dst_buf] = r.dst_offset;
+                buf[r.dst_buf] = r.dst_offset ? (uint8_t *)malloc(r.dst_offset) : NULL;
+                if (!buf[r.dst_buf])
+                {
+                    size[r.dst_buf] = 0;
+                    continue;
+                }
+                for (i = 0; i < size[r.dst_buf] / sizeof(pixel); i++)
+                {
+                    ((pixel *)buf[r.dst_buf])[i] = (i * 97 + (i >> 7) * 31) & ((1 << BIT_DEPTH) - 1);
+                }
+            }
+            continue;
+        }
+        if (r.bit_depth != BIT_DEPTH || r.kernel >= UHD_TRACE_NB)
+        {
+            continue;
+        }
+        dst = uhd_trace_resolve(buf, size, &scratch[0], &scratch_size[0], r.dst_buf, r.dst_offset, dststride, h);
+        src = uhd_trace_resolve(buf, size, &scratch[1], &scratch_size[1], r.src_buf, r.src_offset, srcstride, h);
+        if (!dst || !src)
+        {
+            continue;
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
-    }
 
-    tmp = tmp_array + QPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_qpel_filters[my - 1];
+        start = uhd_ticks();
+        switch (r.kernel)
+        {
+            UHD_TRACE_KERNELS(UHD_TRACE_CASE)
+        }
+        total += uhd_ticks() - start;
+        calls++;
+    }
 
-    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
-    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    for (i = 0; i < UHD_TRACE_NB_BUF; i++)
     {
-        for (x = 0; x < width; x++)
-            dst[x] = uhd_clip_pixel(((QPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) * wx1 + src2[x] * wx0 +
-                                     ((ox0 + ox1 + 1) << log2Wd)) >>
-                                    (log2Wd + 1));
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+        free(buf[i]);
+    }
+    free(scratch[0]);
+    free(scratch[1]);
+    fclose(f);
+    if (ticks)
+    {
+        *ticks = total;
     }
+    return calls;
 }
 
+#undef PUT_TRACE
+#undef PUT_TRACE_MY_PUT
+#undef PUT_TRACE_MY_UNI
+#undef PUT_TRACE_MY_BI
+#undef PUT_TRACE_MY_UNI_W
+#undef PUT_TRACE_MY_BI_W
+#undef PUT_TRACE_MY_SAO_BAND
+#undef PUT_TRACE_MY_SAO_EDGE
+#undef UHD_TRACE_CASE
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
-//
+// Self-tests (build with UHD_KERNEL_SELFTEST). uhd_selftest_run runs the
+// exactness checks kept next to their kernels and reports each one to
+// report (if not NULL). Returns the number of failing checks.
 ////////////////////////////////////////////////////////////////////////////////
-#define EPEL_FILTER(src, stride)   \
-    (filter[0] * src[x - stride] + \
-     filter[1] * src[x] +          \
-     filter[2] * src[x + stride] + \
-     filter[3] * src[x + 2 * stride])
+#ifdef UHD_KERNEL_SELFTEST
+#include <stdio.h>
 
-static void FUNC(put_hevc_epel_h)(int16_t *dst,
-                                  uint8_t *_src, ptrdiff_t _srcstride,
-                                  int height, intptr_t mx, intptr_t my, int width)
+static int FUNC(uhd_selftest_run)(FILE *report)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    for (y = 0; y < height; y++)
+    static const struct
     {
-        for (x = 0; x < width; x++)
+        const char *name;
+        int (*run)(void);
+    } tests[] = {
+        {"qpel_hv_filter_col16", FUNC(selftest_qpel_hv_filter_col16)},
+        {"fdct_roundtrip", FUNC(selftest_fdct_roundtrip)},
+    };
+    int i, failed = 0;
+
+    for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++)
+    {
+        int fails = tests[i].run();
+
+        failed += fails != 0;
+        if (report)
         {
-            dst[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            fprintf(report, "%-4s %-28s %2d-bit %d mismatches\n", fails ? "FAIL" : "ok", tests[i].name, BIT_DEPTH,
+                    fails);
         }
-        src += srcstride;
-        dst += MAX_PB_SIZE;
     }
+    return failed;
 }
+#endif
 
-static void FUNC(put_hevc_epel_v)(int16_t *dst,
-                                  uint8_t *_src, ptrdiff_t _srcstride,
-                                  int height, intptr_t mx, intptr_t my, int width)
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark baselines (build with UHD_KERNEL_BENCH). uhd_bench_run times the
+// hot MC and SAO kernels and their alternative forms, each under its own
+// variant name, at the square and 4xN block sizes. uhd_bench_write_json
+// stores the results as a baseline, and uhd_bench_compare checks a new run
+// against it. A result is a regression when its median exceeds the baseline
+// by more than the relative tolerance plus three standard deviations of the
+// combined noise, where each run's deviation is estimated as 1.4826 * MAD.
+// A bench tool returns non-zero when uhd_bench_compare reports any
+// regressions. uhd_bench_depth_ratio sets the 10-bit results of a run
+// against its 8-bit ones.
+////////////////////////////////////////////////////////////////////////////////
+#ifdef UHD_KERNEL_BENCH
+#ifndef UHD_KERNEL_BENCH_STATE
+#define UHD_KERNEL_BENCH_STATE
+#include <math.h>
+#include <stdio.h>
+
+#define UHD_BENCH_SAMPLES 31
+#define UHD_BENCH_MAX_RESULTS 512
+
+typedef struct UHDBenchResult
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
+    char primitive[32];
+    char variant[16];
+    int width;
+    int height;
+    int bit_depth;
+    double median_ns;        // per call
+    double mad_ns;           // median absolute deviation of the samples
+    double cycles_per_pixel; // 0 when the CPU clock was not given
+} UHDBenchResult;
+
+// the kernels uhd_bench_call can run
+enum
+{
+    UHD_BENCH_QPEL_H,
+    UHD_BENCH_QPEL_V,
+    UHD_BENCH_QPEL_HV,
+    UHD_BENCH_QPEL_UNI_HV,
+    UHD_BENCH_QPEL_BI_HV,
+    UHD_BENCH_EPEL_HV,
+    UHD_BENCH_SAO_BAND,
+    UHD_BENCH_SAO_EDGE,
+    UHD_BENCH_QPEL_ROWS_H,
+    UHD_BENCH_QPEL_ROWS_V,
+    UHD_BENCH_QPEL_ROWS_HV,
+    UHD_BENCH_QPEL_UNI_HV_NT,
+    UHD_BENCH_QPEL_BI_HV_NT,
+    UHD_BENCH_SAO_BAND_NT,
+    UHD_BENCH_SAO_EDGE_NT,
+    UHD_BENCH_STREAM,
+    UHD_BENCH_STREAM_NT,
+    UHD_BENCH_QPEL_UNI_HV_PB_RING,
+};
+
+// The stream entries write put_hevc_qpel_uni_hv output block by block across
+// a picture-sized buffer, as a decoder writes a picture that is not used as
+// a reference. Each call then runs put_hevc_qpel_hv on the next block of a
+// reference area of a few hundred KB, which is revisited as the blocks wrap.
+// If the output store evicts that area, the following MC misses the cache,
+// and the time of the pair shows it. Compare the "neon" and "nt" variants.
+#define UHD_BENCH_FRAME_W 1920
+#define UHD_BENCH_FRAME_H 1080
+#define UHD_BENCH_REF_W 512
+#define UHD_BENCH_REF_H 256
+
+#define UHD_BENCH_NARROW 1 // also time the 4xN shapes
+#define UHD_BENCH_PACKED 2   // 4xN shapes take the packed path and report as "packed"
+#define UHD_BENCH_UNPACKED 4 // only the shapes packing covers, with packing turned off
+
+// One timed configuration. Alternative forms of a primitive keep its name
+// and differ in variant, which is also how baselines tell them apart.
+typedef struct UHDBenchEntry
+{
+    const char *primitive;
+    const char *variant;
+    int kernel;
+    int flags;
+} UHDBenchEntry;
 
-    for (y = 0; y < height; y++)
+typedef struct UHDBenchCtx
+{
+    int kernel;
+    uint8_t *src;
+    uint8_t *dst;
+    ptrdiff_t srcstride;
+    ptrdiff_t dststride;
+    int16_t *tmp;
+    uint8_t *frame; // output of the stream entries, UHD_BENCH_FRAME_W x UHD_BENCH_FRAME_H
+    ptrdiff_t framestride;
+    uint8_t *ref; // UHD_BENCH_REF_W x UHD_BENCH_REF_H, read by the MC after each output block
+    ptrdiff_t refstride;
+    unsigned pos; // blocks written so far
+} UHDBenchCtx;
+
+static int uhd_bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// median and median absolute deviation of s[0 .. n - 1]; reorders s
+static void uhd_bench_stats(double *s, int n, double *median, double *mad)
+{
+    int i;
+
+    qsort(s, n, sizeof(*s), uhd_bench_cmp_double);
+    *median = n & 1 ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+    for (i = 0; i < n; i++)
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8);
-        }
-        src += srcstride;
-        dst += MAX_PB_SIZE;
+        s[i] = fabs(s[i] - *median);
     }
+    qsort(s, n, sizeof(*s), uhd_bench_cmp_double);
+    *mad = n & 1 ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
 }
 
-static void FUNC(put_hevc_epel_hv)(int16_t *dst,
-                                   uint8_t *_src, ptrdiff_t _srcstride,
-                                   int height, intptr_t mx, intptr_t my, int width)
+// Takes UHD_BENCH_SAMPLES samples of ns per call. Each sample batches enough
+// calls to last at least 20 us, so the timer resolution does not dominate.
+static void uhd_bench_measure(void (*run)(void *, int, int), void *opaque, int width, int height,
+                              double *median, double *mad)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int16_t tmp_array[(MAX_PB_SIZE + EPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-
-    src -= EPEL_EXTRA_BEFORE * srcstride;
+    double samples[UHD_BENCH_SAMPLES];
+    double ns_per_tick = 1e9 / uhd_ticks_per_second();
+    uint64_t min_ticks = uhd_ticks_per_second() / 50000;
+    uint64_t t;
+    int i, k, reps = 1;
 
-    for (y = 0; y < height + EPEL_EXTRA; y++)
+    for (;;)
     {
-        for (x = 0; x < width; x++)
+        t = uhd_ticks();
+        for (k = 0; k < reps; k++)
         {
-            tmp[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            run(opaque, width, height);
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
+        if (uhd_ticks() - t >= min_ticks || reps >= 1 << 20)
+        {
+            break;
+        }
+        reps *= 2;
     }
-
-    tmp = tmp_array + EPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_epel_filters[my - 1];
-
-    for (y = 0; y < height; y++)
+    for (i = 0; i < UHD_BENCH_SAMPLES; i++)
     {
-        for (x = 0; x < width; x++)
+        t = uhd_ticks();
+        for (k = 0; k < reps; k++)
         {
-            dst[x] = EPEL_FILTER(tmp, MAX_PB_SIZE) >> 6;
+            run(opaque, width, height);
         }
-        tmp += MAX_PB_SIZE;
-        dst += MAX_PB_SIZE;
+        samples[i] = (uhd_ticks() - t) * ns_per_tick / reps;
     }
+    uhd_bench_stats(samples, UHD_BENCH_SAMPLES, median, mad);
 }
 
-static void FUNC(put_hevc_epel_uni_h)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                      int height, intptr_t mx, intptr_t my, int width)
+static void uhd_bench_write_json(FILE *f, const UHDBenchResult *res, int nb_res)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int shift = 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    int i;
 
-    for (y = 0; y < height; y++)
+    fprintf(f, "{\"results\": [\n");
+    for (i = 0; i < nb_res; i++)
     {
-        for (x = 0; x < width; x++)
-        {
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) + offset) >> shift);
-        }
-        src += srcstride;
-        dst += dststride;
+        fprintf(f,
+                "  {\"primitive\": \"%s\", \"width\": %d, \"height\": %d, \"bit_depth\": %d, \"variant\": \"%s\", "
+                "\"median_ns\": %.3f, \"mad_ns\": %.3f, \"cycles_per_pixel\": %.4f}%s\n",
+                res[i].primitive, res[i].width, res[i].height, res[i].bit_depth, res[i].variant,
+                res[i].median_ns, res[i].mad_ns, res[i].cycles_per_pixel, i + 1 < nb_res ? "," : "");
     }
+    fprintf(f, "]}\n");
 }
 
-static void FUNC(put_hevc_epel_bi_h)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                     int16_t *src2,
-                                     int height, intptr_t mx, intptr_t my, int width)
+// Reads a baseline written by uhd_bench_write_json, one result per line.
+// Returns the number of results read, or -1 if path cannot be opened.
+static int uhd_bench_load_json(const char *path, UHDBenchResult *res, int max_res)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int shift = 14 + 1 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    char line[512];
+    int n = 0;
+    FILE *f = fopen(path, "r");
 
-    for (y = 0; y < height; y++)
+    if (!f)
     {
-        for (x = 0; x < width; x++)
+        return -1;
+    }
+    while (n < max_res && fgets(line, sizeof(line), f))
+    {
+        UHDBenchResult *r = &res[n];
+
+        if (sscanf(line,
+                   " {\"primitive\": \"%31[^\"]\", \"width\": %d, \"height\": %d, \"bit_depth\": %d, "
+                   "\"variant\": \"%15[^\"]\", \"median_ns\": %lf, \"mad_ns\": %lf, \"cycles_per_pixel\": %lf",
+                   r->primitive, &r->width, &r->height, &r->bit_depth, r->variant,
+                   &r->median_ns, &r->mad_ns, &r->cycles_per_pixel) == 8)
         {
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) + src2[x] + offset) >> shift);
+            n++;
         }
-        dst += dststride;
-        src += srcstride;
-        src2 += MAX_PB_SIZE;
     }
+    fclose(f);
+    return n;
 }
 
-static void FUNC(put_hevc_epel_uni_v)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                      int height, intptr_t mx, intptr_t my, int width)
+// Compares every current result with the baseline entry of the same
+// primitive, size, depth and variant, and reports each one to report (if not
+// NULL). tolerance is relative, e.g. 0.05. Returns the number of regressions.
+static int uhd_bench_compare(const UHDBenchResult *base, int nb_base, const UHDBenchResult *cur, int nb_cur,
+                             double tolerance, FILE *report)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
-    int shift = 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    int i, j, regressions = 0;
 
-    for (y = 0; y < height; y++)
+    for (i = 0; i < nb_cur; i++)
     {
-        for (x = 0; x < width; x++)
+        const UHDBenchResult *c = &cur[i];
+
+        for (j = 0; j < nb_base; j++)
         {
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) + offset) >> shift);
+            const UHDBenchResult *b = &base[j];
+            double noise, limit;
+            int slow;
+
+            if (strcmp(b->primitive, c->primitive) || strcmp(b->variant, c->variant) || b->width != c->width ||
+                b->height != c->height || b->bit_depth != c->bit_depth)
+            {
+                continue;
+            }
+            noise = 1.4826 * sqrt(b->mad_ns * b->mad_ns + c->mad_ns * c->mad_ns);
+            limit = b->median_ns * (1 + tolerance) + 3 * noise;
+            slow = c->median_ns > limit;
+            regressions += slow;
+            if (report)
+            {
+                fprintf(report, "%-6s %-24s %2dx%-2d %2d-bit %-8s %10.1f ns -> %10.1f ns (%+6.1f%%, limit %.1f)\n",
+                        slow ? "SLOWER" : "ok", c->primitive, c->width, c->height, c->bit_depth, c->variant,
+                        b->median_ns, c->median_ns, 100 * (c->median_ns / b->median_ns - 1), limit);
+            }
+            break;
         }
-        src += srcstride;
-        dst += dststride;
     }
+    return regressions;
 }
 
-static void FUNC(put_hevc_epel_bi_v)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                     int16_t *src2,
-                                     int height, intptr_t mx, intptr_t my, int width)
+// Pairs each 8-bit result whose primitive starts with prefix (all if NULL)
+// with the 10-bit result of the same primitive, variant and size, and
+// reports the ratio of their medians to report (if not NULL). Returns the
+// number of pairs whose 10-bit median exceeds target times the 8-bit one,
+// e.g. target 1.3 for the high bit depth MC.
+static int uhd_bench_depth_ratio(const UHDBenchResult *res, int nb_res, const char *prefix, double target,
+                                 FILE *report)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    int shift = 14 + 1 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    int i, j, over = 0;
 
-    for (y = 0; y < height; y++)
+    for (i = 0; i < nb_res; i++)
     {
-        for (x = 0; x < width; x++)
+        const UHDBenchResult *a = &res[i];
+
+        if (a->bit_depth != 8 || (prefix && strncmp(a->primitive, prefix, strlen(prefix))))
         {
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) + src2[x] + offset) >> shift);
+            continue;
+        }
+        for (j = 0; j < nb_res; j++)
+        {
+            const UHDBenchResult *b = &res[j];
+            double ratio;
+
+            if (b->bit_depth != 10 || strcmp(a->primitive, b->primitive) || strcmp(a->variant, b->variant) ||
+                a->width != b->width || a->height != b->height)
+            {
+                continue;
+            }
+            ratio = b->median_ns / a->median_ns;
+            over += ratio > target;
+            if (report)
+            {
+                fprintf(report, "%-6s %-24s %2dx%-2d %-8s 8-bit %10.1f ns, 10-bit %10.1f ns (%.2fx, target %.2fx)\n",
+                        ratio > target ? "OVER" : "ok", a->primitive, a->width, a->height, a->variant,
+                        a->median_ns, b->median_ns, ratio, target);
+            }
+            break;
         }
-        dst += dststride;
-        src += srcstride;
-        src2 += MAX_PB_SIZE;
     }
+    return over;
 }
+#endif
 
-static void FUNC(put_hevc_epel_uni_hv)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                       int height, intptr_t mx, intptr_t my, int width)
+// one call of the stream entries: the output block, then the reference MC
+static void FUNC(uhd_bench_stream)(UHDBenchCtx *b, int width, int height, int nt)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int16_t tmp_array[(MAX_PB_SIZE + EPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    int shift = 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
+    int cols = UHD_BENCH_FRAME_W / width, rows = UHD_BENCH_FRAME_H / height;
+    int ref_cols = UHD_BENCH_REF_W / width, ref_rows = UHD_BENCH_REF_H / height;
+    unsigned pos = b->pos++;
+    uint8_t *out = b->frame + (pos / cols % rows) * height * b->framestride + (pos % cols) * width * sizeof(pixel);
+    uint8_t *ref = b->ref + (pos / ref_cols % ref_rows) * height * b->refstride +
+                   (pos % ref_cols) * width * sizeof(pixel);
+
+    if (nt)
+    {
+        FUNC(put_hevc_qpel_uni_hv_nt)(out, b->framestride, b->src, b->srcstride, height, 2, 2, width);
+    }
+    else
+    {
+        FUNC(put_hevc_qpel_uni_hv)(out, b->framestride, b->src, b->srcstride, height, 2, 2, width);
+    }
+    FUNC(put_hevc_qpel_hv)(b->tmp, ref, b->refstride, height, 2, 2, width);
+}
+
+static void FUNC(uhd_bench_call)(void *opaque, int width, int height)
+{
+    static int16_t sao_offset[8] = {0, 2, 1, -1, -2};
+    UHDBenchCtx *b = (UHDBenchCtx *)opaque;
+
+    switch (b->kernel)
+    {
+    case UHD_BENCH_QPEL_H:
+        FUNC(put_hevc_qpel_h)(b->tmp, b->src, b->srcstride, height, 2, 0, width);
+        break;
+    case UHD_BENCH_QPEL_V:
+        FUNC(put_hevc_qpel_v)(b->tmp, b->src, b->srcstride, height, 0, 2, width);
+        break;
+    case UHD_BENCH_QPEL_HV:
+        FUNC(put_hevc_qpel_hv)(b->tmp, b->src, b->srcstride, height, 2, 2, width);
+        break;
+    case UHD_BENCH_QPEL_UNI_HV:
+        FUNC(put_hevc_qpel_uni_hv)(b->dst, b->dststride, b->src, b->srcstride, height, 2, 2, width);
+        break;
+    case UHD_BENCH_QPEL_BI_HV:
+        FUNC(put_hevc_qpel_bi_hv)(b->dst, b->dststride, b->src, b->srcstride, b->tmp, height, 2, 2, width);
+        break;
+    case UHD_BENCH_EPEL_HV:
+        FUNC(put_hevc_epel_hv)(b->tmp, b->src, b->srcstride, height, 4, 4, width);
+        break;
+    case UHD_BENCH_SAO_BAND:
+        FUNC(sao_band_filter)(b->dst, b->src, b->dststride, b->srcstride, sao_offset, 12, width, height);
+        break;
+    case UHD_BENCH_SAO_EDGE:
+        // reads the fixed-stride CTB copy, which src also satisfies
+        FUNC(sao_edge_filter)(b->dst, b->src, b->dststride, sao_offset, 2, width, height);
+        break;
+    case UHD_BENCH_QPEL_ROWS_H:
+        FUNC(put_hevc_qpel_rows)(b->tmp, b->src, b->srcstride, height, 2, 0, width);
+        break;
+    case UHD_BENCH_QPEL_ROWS_V:
+        FUNC(put_hevc_qpel_rows)(b->tmp, b->src, b->srcstride, height, 0, 2, width);
+        break;
+    case UHD_BENCH_QPEL_ROWS_HV:
+        FUNC(put_hevc_qpel_rows)(b->tmp, b->src, b->srcstride, height, 2, 2, width);
+        break;
+    case UHD_BENCH_QPEL_UNI_HV_NT:
+        FUNC(put_hevc_qpel_uni_hv_nt)(b->dst, b->dststride, b->src, b->srcstride, height, 2, 2, width);
+        break;
+    case UHD_BENCH_QPEL_BI_HV_NT:
+        FUNC(put_hevc_qpel_bi_hv_nt)(b->dst, b->dststride, b->src, b->srcstride, b->tmp, height, 2, 2, width);
+        break;
+    case UHD_BENCH_SAO_BAND_NT:
+        FUNC(sao_band_filter_nt)(b->dst, b->src, b->dststride, b->srcstride, sao_offset, 12, width, height);
+        break;
+    case UHD_BENCH_SAO_EDGE_NT:
+        FUNC(sao_edge_filter_nt)(b->dst, b->src, b->dststride, sao_offset, 2, width, height);
+        break;
+    case UHD_BENCH_QPEL_UNI_HV_PB_RING:
+        FUNC(put_hevc_qpel_uni_hv_ring)(b->dst, b->dststride, b->src, b->srcstride, height, 2, 2, width,
+                                        MAX_PB_SIZE, 0);
+        break;
+    default:
+        FUNC(uhd_bench_stream)(b, width, height, b->kernel == UHD_BENCH_STREAM_NT);
+        break;
+    }
+}
+
+// Times every entry below at 8x8 .. 64x64, and narrow entries also at 4x4,
+// 4x8 and 4x16, into res (UHD_BENCH_MAX_RESULTS fits every depth). cpu_hz, if
+// known, turns the medians into cycles per pixel. Returns the number of
+// results, or -1 on allocation failure.
+static int FUNC(uhd_bench_run)(UHDBenchResult *res, int max_res, double cpu_hz)
+{
+    static const UHDBenchEntry entries[] = {
+        {"put_hevc_qpel_h", "neon", UHD_BENCH_QPEL_H, UHD_BENCH_NARROW | UHD_BENCH_PACKED},
+        {"put_hevc_qpel_v", "neon", UHD_BENCH_QPEL_V, UHD_BENCH_NARROW | UHD_BENCH_PACKED},
+        {"put_hevc_qpel_hv", "neon", UHD_BENCH_QPEL_HV, UHD_BENCH_NARROW | UHD_BENCH_PACKED},
+        {"put_hevc_qpel_uni_hv", "neon", UHD_BENCH_QPEL_UNI_HV, UHD_BENCH_NARROW},
+        {"put_hevc_qpel_bi_hv", "neon", UHD_BENCH_QPEL_BI_HV, UHD_BENCH_NARROW},
+        {"put_hevc_epel_hv", "neon", UHD_BENCH_EPEL_HV, UHD_BENCH_NARROW | UHD_BENCH_PACKED},
+        {"sao_band_filter", "neon", UHD_BENCH_SAO_BAND, 0},
+        {"sao_edge_filter", "neon", UHD_BENCH_SAO_EDGE, 0},
+        // the auto-tuner's generic alternative to the three kernels above
+        {"put_hevc_qpel_h", "rows", UHD_BENCH_QPEL_ROWS_H, UHD_BENCH_NARROW},
+        {"put_hevc_qpel_v", "rows", UHD_BENCH_QPEL_ROWS_V, UHD_BENCH_NARROW},
+        {"put_hevc_qpel_hv", "rows", UHD_BENCH_QPEL_ROWS_HV, UHD_BENCH_NARROW},
+        // streaming stores, and their effect on the MC that reads the next reference block
+        {"put_hevc_qpel_uni_hv", "nt", UHD_BENCH_QPEL_UNI_HV_NT, UHD_BENCH_NARROW},
+        {"put_hevc_qpel_bi_hv", "nt", UHD_BENCH_QPEL_BI_HV_NT, UHD_BENCH_NARROW},
+        {"sao_band_filter", "nt", UHD_BENCH_SAO_BAND_NT, 0},
+        {"sao_edge_filter", "nt", UHD_BENCH_SAO_EDGE_NT, 0},
+        {"qpel_uni_hv_then_qpel_hv", "neon", UHD_BENCH_STREAM, UHD_BENCH_NARROW},
+        {"qpel_uni_hv_then_qpel_hv", "nt", UHD_BENCH_STREAM_NT, UHD_BENCH_NARROW},
+        // hv ring rows MAX_PB_SIZE apart instead of RING_STRIDE(width)
+        {"put_hevc_qpel_uni_hv", "pb_ring", UHD_BENCH_QPEL_UNI_HV_PB_RING, UHD_BENCH_NARROW},
+        // the row kernels on the blocks the "packed" results cover
+        {"put_hevc_qpel_h", "unpacked", UHD_BENCH_QPEL_H, UHD_BENCH_NARROW | UHD_BENCH_UNPACKED},
+        {"put_hevc_qpel_v", "unpacked", UHD_BENCH_QPEL_V, UHD_BENCH_NARROW | UHD_BENCH_UNPACKED},
+        {"put_hevc_qpel_hv", "unpacked", UHD_BENCH_QPEL_HV, UHD_BENCH_NARROW | UHD_BENCH_UNPACKED},
+        {"put_hevc_epel_hv", "unpacked", UHD_BENCH_EPEL_HV, UHD_BENCH_NARROW | UHD_BENCH_UNPACKED},
+    };
+    static const int shapes[][2] = {{4, 4}, {4, 8}, {4, 16}, {8, 8}, {16, 16}, {32, 32}, {64, 64}};
+    // the SAO edge source stride, wide enough for 64 pixels plus filter margins
+    const ptrdiff_t srcstride = (2 * MAX_PB_SIZE + UHD_INPUT_BUFFER_PADDING_SIZE) / sizeof(pixel);
+    const int src_rows = MAX_PB_SIZE + 16;
+    pixel *src = (pixel *)malloc(srcstride * src_rows * sizeof(pixel));
+    pixel *dst = (pixel *)malloc(MAX_PB_SIZE * MAX_PB_SIZE * sizeof(pixel));
+    int16_t *tmp = (int16_t *)calloc(MAX_PB_SIZE * MAX_PB_SIZE, sizeof(int16_t));
+    // 8-lane stores of 4-wide blocks and the qpel margins run past the areas
+    const ptrdiff_t framestride = UHD_BENCH_FRAME_W + 16;
+    const ptrdiff_t refstride = UHD_BENCH_REF_W + 32;
+    pixel *frame = (pixel *)malloc(framestride * UHD_BENCH_FRAME_H * sizeof(pixel));
+    pixel *ref = (pixel *)malloc(refstride * (UHD_BENCH_REF_H + 16) * sizeof(pixel));
+    UHDBenchCtx b;
+    int i, k, s, n = -1;
+
+    if (src && dst && tmp && frame && ref)
+    {
+        for (i = 0; i < srcstride * src_rows; i++)
+        {
+            src[i] = (i * 97 + (i >> 5) * 31) & ((1 << BIT_DEPTH) - 1);
+        }
+        b.src = (uint8_t *)(src + 8 * srcstride + 8);
+        b.srcstride = srcstride * sizeof(pixel);
+        b.dst = (uint8_t *)dst;
+        b.dststride = MAX_PB_SIZE * sizeof(pixel);
+        b.tmp = tmp;
+        for (i = 0; i < refstride * (UHD_BENCH_REF_H + 16); i++)
+        {
+            ref[i] = (i * 89 + (i >> 6) * 37) & ((1 << BIT_DEPTH) - 1);
+        }
+        b.frame = (uint8_t *)frame;
+        b.framestride = framestride * sizeof(pixel);
+        b.ref = (uint8_t *)(ref + 8 * refstride + 16);
+        b.refstride = refstride * sizeof(pixel);
+        b.pos = 0;
+
+        n = 0;
+        for (k = 0; k < (int)(sizeof(entries) / sizeof(entries[0])); k++)
+        {
+            const UHDBenchEntry *e = &entries[k];
+
+            for (s = 0; s < (int)(sizeof(shapes) / sizeof(shapes[0])) && n < max_res; s++)
+            {
+                int width = shapes[s][0], height = shapes[s][1];
+                UHDBenchResult *r;
+
+                if ((width < 8 && !(e->flags & UHD_BENCH_NARROW)) ||
+                    ((e->flags & UHD_BENCH_UNPACKED) && !uhd_use_packed(width, height)))
+                {
+                    continue;
+                }
+                r = &res[n++];
+                b.kernel = e->kernel;
+                snprintf(r->primitive, sizeof(r->primitive), "%s", e->primitive);
+                snprintf(r->variant, sizeof(r->variant), "%s",
+                         (e->flags & UHD_BENCH_PACKED) && uhd_use_packed(width, height) ? "packed" : e->variant);
+                r->width = width;
+                r->height = height;
+                r->bit_depth = BIT_DEPTH;
+                uhd_packed_off = !!(e->flags & UHD_BENCH_UNPACKED);
+                uhd_bench_measure(FUNC(uhd_bench_call), &b, width, height, &r->median_ns, &r->mad_ns);
+                uhd_packed_off = 0;
+                r->cycles_per_pixel = cpu_hz > 0 ? r->median_ns * 1e-9 * cpu_hz / (width * height) : 0;
+            }
+        }
+    }
+    free(src);
+    free(dst);
+    free(tmp);
+    free(frame);
+    free(ref);
+    return n;
+}
 #endif
 
-    src -= EPEL_EXTRA_BEFORE * srcstride;
+////////////////////////////////////////////////////////////////////////////////
+// Interpolated block cache (build with UHD_MC_CACHE). Merge candidates and the
+// PUs of a split CU often fetch the same reference area with the same MV. The
+// name_cached wrappers sit in the dispatch table in front of the 14-bit qpel
+// and epel kernels. They split a block into 8x8 tiles and keep each
+// interpolated tile in a small per-thread LRU cache. A tile is keyed by the
+// reference plane id, its sample position in that plane, the filter and the
+// fractional MV, never by its address: edge emulation and scratch buffers get
+// reused for other content at the same address. A decoding thread registers
+// each padded reference plane with uhd_mc_cache_add_ref, and a source that
+// lies in no registered plane (such as an edge emulation buffer) bypasses the
+// cache. uhd_mc_cache_invalidate drops the tiles of a plane whose samples
+// change or whose buffer goes back to the pool. uhd_mc_cache_report prints the
+// thread's hit rate and an estimate of the speedup.
+////////////////////////////////////////////////////////////////////////////////
+#ifdef UHD_MC_CACHE
+#ifndef UHD_MC_CACHE_STATE
+#define UHD_MC_CACHE_STATE
+#include <stdio.h>
+
+#define UHD_MC_CACHE_SET_BITS 6
+#define UHD_MC_CACHE_SETS (1 << UHD_MC_CACHE_SET_BITS)
+#define UHD_MC_CACHE_WAYS 4
+#define UHD_MC_CACHE_TILE 8
+#define UHD_MC_CACHE_MAX_REFS 48 // 16 reference pictures x 3 planes
+#define UHD_MC_CACHE_QPEL 0
+#define UHD_MC_CACHE_EPEL 1
+
+typedef struct UHDMCCacheEntry
+{
+    int32_t ref;    // plane id given to uhd_mc_cache_add_ref
+    int16_t x;      // position of the tile in the plane, in samples
+    int16_t y;
+    uint32_t frame; // entries from an earlier generation are empty
+    uint32_t used;  // LRU stamp
+    int8_t kind;
+    int8_t bit_depth;
+    int8_t mx;
+    int8_t my;
+    int16_t tile[UHD_MC_CACHE_TILE * UHD_MC_CACHE_TILE];
+} UHDMCCacheEntry;
+
+typedef struct UHDMCCacheRef
+{
+    const uint8_t *data; // first picture sample, padded by UHD_FRAME_PADDING
+    ptrdiff_t linesize;
+    int width;
+    int height;
+    int id;
+} UHDMCCacheRef;
+
+typedef struct UHDMCCache
+{
+    UHDMCCacheEntry entry[UHD_MC_CACHE_SETS][UHD_MC_CACHE_WAYS];
+    UHDMCCacheRef ref[UHD_MC_CACHE_MAX_REFS];
+    int nb_refs;
+    uint32_t frame;
+    uint32_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t bypass;     // calls not a multiple of the tile or not in a registered plane
+    uint64_t ticks;      // time in cached calls
+    uint64_t miss_ticks; // time in calls where no tile hit, and their tiles
+    uint64_t miss_tiles;
+} UHDMCCache;
+
+static __thread UHDMCCache uhd_mc_cache = {.frame = 1};
+
+// Drops every tile in O(1) by starting a new generation. Registered planes
+// stay registered.
+static void uhd_mc_cache_new_frame(void)
+{
+    UHDMCCache *c = &uhd_mc_cache;
 
-    for (y = 0; y < height + EPEL_EXTRA; y++)
+    if (!++c->frame)
     {
-        for (x = 0; x < width; x++)
-        {
-            tmp[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
-        }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
+        memset(c->entry, 0, sizeof(c->entry));
+        c->frame = 1;
     }
+    c->clock = 0;
+}
 
-    tmp = tmp_array + EPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_epel_filters[my - 1];
+// Drops the tiles of plane id. Call it when the samples behind id change or
+// its buffer is released; the plane stays registered.
+static void uhd_mc_cache_invalidate(int id)
+{
+    UHDMCCache *c = &uhd_mc_cache;
+    int i, j;
 
-    for (y = 0; y < height; y++)
+    for (i = 0; i < UHD_MC_CACHE_SETS; i++)
     {
-        for (x = 0; x < width; x++)
+        for (j = 0; j < UHD_MC_CACHE_WAYS; j++)
         {
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) + offset) >> shift);
+            if (c->entry[i][j].ref == id)
+            {
+                c->entry[i][j].frame = 0;
+            }
         }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
     }
 }
 
-static void FUNC(put_hevc_epel_bi_hv)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                      int16_t *src2,
-                                      int height, intptr_t mx, intptr_t my, int width)
+// Registers a width x height plane whose first sample is at data, with
+// UHD_FRAME_PADDING samples of border on each side. Re-registering an id
+// with another buffer or geometry drops its tiles. Returns 0, or -1 when the
+// table is full.
+static int uhd_mc_cache_add_ref(int id, const uint8_t *data, ptrdiff_t linesize, int width, int height)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int16_t tmp_array[(MAX_PB_SIZE + EPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    int shift = 14 + 1 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
-
-    src -= EPEL_EXTRA_BEFORE * srcstride;
+    UHDMCCache *c = &uhd_mc_cache;
+    UHDMCCacheRef *r = NULL;
+    int i;
 
-    for (y = 0; y < height + EPEL_EXTRA; y++)
+    for (i = 0; i < c->nb_refs; i++)
     {
-        for (x = 0; x < width; x++)
+        if (c->ref[i].id == id)
         {
-            tmp[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            r = &c->ref[i];
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
     }
+    if (!r)
+    {
+        if (c->nb_refs == UHD_MC_CACHE_MAX_REFS)
+        {
+            return -1;
+        }
+        r = &c->ref[c->nb_refs++];
+    }
+    else if (r->data == data && r->linesize == linesize && r->width == width && r->height == height)
+    {
+        return 0;
+    }
+    uhd_mc_cache_invalidate(id);
+    r->data = data;
+    r->linesize = linesize;
+    r->width = width;
+    r->height = height;
+    r->id = id;
+    return 0;
+}
 
-    tmp = tmp_array + EPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_epel_filters[my - 1];
+static void uhd_mc_cache_remove_ref(int id)
+{
+    UHDMCCache *c = &uhd_mc_cache;
+    int i;
 
-    for (y = 0; y < height; y++)
+    uhd_mc_cache_invalidate(id);
+    for (i = 0; i < c->nb_refs; i++)
     {
-        for (x = 0; x < width; x++)
+        if (c->ref[i].id == id)
         {
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) + src2[x] + offset) >> shift);
-            // printf("\n%d",dst[x]);
+            c->ref[i] = c->ref[--c->nb_refs];
+            return;
         }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
     }
-    // exit(0);
 }
 
-static void FUNC(put_hevc_epel_uni_w_h)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                        int height, int denom, int wx, int ox, intptr_t mx, intptr_t my, int width)
+// Finds the registered plane holding the width x height block at src and
+// returns its id and the block position, or -1 when the block is not inside
+// the padded area of any plane read with this stride.
+static int uhd_mc_cache_locate(const UHDMCCache *c, const uint8_t *src, ptrdiff_t srcstride, int pixel_size,
+                               int width, int height, int *x, int *y)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int shift = denom + 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    int i;
 
-    ox = ox * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    for (i = 0; i < c->nb_refs; i++)
     {
-        for (x = 0; x < width; x++)
+        const UHDMCCacheRef *r = &c->ref[i];
+        // src may belong to another allocation: compare addresses as integers
+        // and reject anything outside the padded plane before narrowing
+        ptrdiff_t off = (ptrdiff_t)((uintptr_t)src - (uintptr_t)r->data);
+        ptrdiff_t row, col;
+
+        if (r->linesize != srcstride ||
+            off < -(ptrdiff_t)UHD_FRAME_PADDING * (r->linesize + pixel_size) ||
+            off >= (ptrdiff_t)(r->height + UHD_FRAME_PADDING) * r->linesize)
         {
-            dst[x] = uhd_clip_pixel((((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) * wx + offset) >> shift) + ox);
+            continue;
         }
-        dst += dststride;
-        src += srcstride;
+        row = off / r->linesize;
+        col = off % r->linesize;
+        if (col % pixel_size)
+        {
+            continue;
+        }
+        if (col < 0)
+        {
+            col += r->linesize;
+            row--;
+        }
+        col /= pixel_size;
+        // the left border of a row sits at the end of the row above
+        if (col >= r->linesize / pixel_size - UHD_FRAME_PADDING)
+        {
+            col -= r->linesize / pixel_size;
+            row++;
+        }
+        if (uhd_mc_needs_edge_emu((int)col, (int)row, width, height, r->width, r->height, UHD_FRAME_PADDING))
+        {
+            continue;
+        }
+        *x = (int)col;
+        *y = (int)row;
+        return r->id;
     }
+    return -1;
 }
 
-static void FUNC(put_hevc_epel_bi_w_h)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                       int16_t *src2,
-                                       int height, int denom, int wx0, int wx1,
-                                       int ox0, int ox1, intptr_t mx, intptr_t my, int width)
+// The speedup is the time the cached calls would have taken at the cost per
+// tile of the calls that missed everywhere, over the time they took.
+static void uhd_mc_cache_report(FILE *f)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int shift = 14 + 1 - BIT_DEPTH;
-    int log2Wd = denom + shift - 1;
+    const UHDMCCache *c = &uhd_mc_cache;
+    uint64_t tiles = c->hits + c->misses;
+    double speedup = 0;
 
-    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
-    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    if (c->miss_tiles && c->ticks)
     {
-        for (x = 0; x < width; x++)
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8)) * wx1 + src2[x] * wx0 +
-                                     ((ox0 + ox1 + 1) << log2Wd)) >>
-                                    (log2Wd + 1));
-        src += srcstride;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+        speedup = (double)c->miss_ticks / c->miss_tiles * tiles / c->ticks;
     }
+    fprintf(f, "mc cache: %llu tiles, %.1f%% hits, %llu calls bypassed, est. speedup %.2fx\n",
+            (unsigned long long)tiles, tiles ? 100.0 * c->hits / tiles : 0.0,
+            (unsigned long long)c->bypass, speedup);
 }
 
-static void FUNC(put_hevc_epel_uni_w_v)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                        int height, int denom, int wx, int ox, intptr_t mx, intptr_t my, int width)
+static inline unsigned uhd_mc_cache_set(int ref, int x, int y, int kind, int mx, int my)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
-    int shift = denom + 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    uint64_t h = (uint64_t)(uint32_t)ref << 32 ^ ((uint32_t)y << 16 ^ (uint32_t)(x & 0xFFFF)) ^
+                 (uint64_t)(kind << 8 | mx << 4 | my) << 48;
 
-    ox = ox * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    return (unsigned)((h * 0x9E3779B97F4A7C15ull) >> (64 - UHD_MC_CACHE_SET_BITS));
+}
+
+// Returns the entry holding the tile, or NULL with *victim set to the way to
+// refill: an empty one if the set has one, else the least recently used.
+static UHDMCCacheEntry *uhd_mc_cache_find(UHDMCCache *c, int ref, int x, int y, int kind, int bit_depth,
+                                          int mx, int my, UHDMCCacheEntry **victim)
+{
+    UHDMCCacheEntry *set = c->entry[uhd_mc_cache_set(ref, x, y, kind, mx, my)];
+    uint32_t oldest = UINT32_MAX;
+    int i;
+
+    for (i = 0; i < UHD_MC_CACHE_WAYS; i++)
     {
-        for (x = 0; x < width; x++)
+        UHDMCCacheEntry *e = &set[i];
+        uint32_t age = e->frame == c->frame ? e->used : 0;
+
+        if (age && e->ref == ref && e->x == x && e->y == y && e->kind == kind &&
+            e->bit_depth == bit_depth && e->mx == mx && e->my == my)
         {
-            dst[x] = uhd_clip_pixel((((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) * wx + offset) >> shift) + ox);
+            e->used = ++c->clock;
+            return e;
+        }
+        if (age < oldest)
+        {
+            oldest = age;
+            *victim = e;
         }
-        dst += dststride;
-        src += srcstride;
     }
+    return NULL;
 }
 
-static void FUNC(put_hevc_epel_bi_w_v)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                       int16_t *src2,
-                                       int height, int denom, int wx0, int wx1,
-                                       int ox0, int ox1, intptr_t mx, intptr_t my, int width)
+static void uhd_mc_cache_fill(UHDMCCache *c, UHDMCCacheEntry *e, int ref, int x, int y, int kind,
+                              int bit_depth, int mx, int my, const int16_t *dst)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[my - 1];
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    int shift = 14 + 1 - BIT_DEPTH;
-    int log2Wd = denom + shift - 1;
+    int i;
 
-    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
-    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    e->ref = ref;
+    e->x = x;
+    e->y = y;
+    e->frame = c->frame;
+    e->used = ++c->clock;
+    e->kind = kind;
+    e->bit_depth = bit_depth;
+    e->mx = mx;
+    e->my = my;
+    for (i = 0; i < UHD_MC_CACHE_TILE; i++)
     {
-        for (x = 0; x < width; x++)
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(src, srcstride) >> (BIT_DEPTH - 8)) * wx1 + src2[x] * wx0 +
-                                     ((ox0 + ox1 + 1) << log2Wd)) >>
-                                    (log2Wd + 1));
-        src += srcstride;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+        memcpy(e->tile + i * UHD_MC_CACHE_TILE, dst + i * MAX_PB_SIZE, UHD_MC_CACHE_TILE * sizeof(int16_t));
     }
 }
+#endif
 
-static void FUNC(put_hevc_epel_uni_w_hv)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                         int height, int denom, int wx, int ox, intptr_t mx, intptr_t my, int width)
+// Filters the block at (x0, y0) of reference plane ref through the cache. The
+// caller vouches that _src holds those samples; the name_cached wrappers get
+// the key from the registered planes instead. Hits are copied out before any
+// miss refills its victim, since a refill may evict a tile that hit in the
+// same call. If no tile hits, the whole block is interpolated in one call (no
+// per-tile filter margins) and then cached.
+static void FUNC(put_hevc_cached)(UHDQpelPutFn fn, int kind, int16_t *dst, uint8_t *_src, ptrdiff_t _srcstride,
+                                  int ref, int x0, int y0, int height, intptr_t mx, intptr_t my, int width)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int16_t tmp_array[(MAX_PB_SIZE + EPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    int shift = denom + 14 - BIT_DEPTH;
-#if BIT_DEPTH < 14
-    int offset = 1 << (shift - 1);
-#else
-    int offset = 0;
-#endif
+    enum { TILES = (MAX_PB_SIZE / UHD_MC_CACHE_TILE) * (MAX_PB_SIZE / UHD_MC_CACHE_TILE) };
+    UHDMCCache *c = &uhd_mc_cache;
+    UHDMCCacheEntry *hit[TILES];
+    UHDMCCacheEntry *victim[TILES];
+    int tiles_x = width / UHD_MC_CACHE_TILE;
+    int nb_tiles = tiles_x * (height / UHD_MC_CACHE_TILE);
+    int nb_hits = 0;
+    int i, y;
+    uint64_t start = uhd_ticks();
+
+    if ((width | height) % UHD_MC_CACHE_TILE || ref < 0)
+    {
+        c->bypass++;
+        fn(dst, _src, _srcstride, height, mx, my, width);
+        return;
+    }
 
-    src -= EPEL_EXTRA_BEFORE * srcstride;
+    for (i = 0; i < nb_tiles; i++)
+    {
+        int tx = x0 + i % tiles_x * UHD_MC_CACHE_TILE;
+        int ty = y0 + i / tiles_x * UHD_MC_CACHE_TILE;
+        int16_t *tile = dst + (i / tiles_x * MAX_PB_SIZE + i % tiles_x) * UHD_MC_CACHE_TILE;
+
+        hit[i] = uhd_mc_cache_find(c, ref, tx, ty, kind, BIT_DEPTH, mx, my, &victim[i]);
+        if (hit[i])
+        {
+            for (y = 0; y < UHD_MC_CACHE_TILE; y++)
+            {
+                memcpy(tile + y * MAX_PB_SIZE, hit[i]->tile + y * UHD_MC_CACHE_TILE,
+                       UHD_MC_CACHE_TILE * sizeof(int16_t));
+            }
+            nb_hits++;
+        }
+    }
+    if (!nb_hits)
+    {
+        fn(dst, _src, _srcstride, height, mx, my, width);
+    }
 
-    for (y = 0; y < height + EPEL_EXTRA; y++)
+    for (i = 0; i < nb_tiles; i++)
     {
-        for (x = 0; x < width; x++)
+        uint8_t *src = _src + (i / tiles_x * _srcstride + i % tiles_x * sizeof(pixel)) * UHD_MC_CACHE_TILE;
+        int16_t *tile = dst + (i / tiles_x * MAX_PB_SIZE + i % tiles_x) * UHD_MC_CACHE_TILE;
+
+        if (!hit[i])
         {
-            tmp[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            if (nb_hits)
+            {
+                fn(tile, src, _srcstride, UHD_MC_CACHE_TILE, mx, my, UHD_MC_CACHE_TILE);
+            }
+            uhd_mc_cache_fill(c, victim[i], ref, x0 + i % tiles_x * UHD_MC_CACHE_TILE,
+                              y0 + i / tiles_x * UHD_MC_CACHE_TILE, kind, BIT_DEPTH, mx, my, tile);
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
     }
 
-    tmp = tmp_array + EPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_epel_filters[my - 1];
+    c->hits += nb_hits;
+    c->misses += nb_tiles - nb_hits;
+    start = uhd_ticks() - start;
+    c->ticks += start;
+    if (!nb_hits)
+    {
+        c->miss_ticks += start;
+        c->miss_tiles += nb_tiles;
+    }
+}
 
-    ox = ox * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+#define PUT_CACHED(name, kind)                                                                  \
+    static void FUNC(name##_cached)(int16_t *dst, uint8_t *_src, ptrdiff_t _srcstride,          \
+                                    int height, intptr_t mx, intptr_t my, int width)            \
+    {                                                                                           \
+        int x0 = 0, y0 = 0;                                                                     \
+        int ref = uhd_mc_cache_locate(&uhd_mc_cache, _src, _srcstride, sizeof(pixel), width,    \
+                                      height, &x0, &y0);                                        \
+        FUNC(put_hevc_cached)(FUNC(name), kind, dst, _src, _srcstride, ref, x0, y0, height,     \
+                              mx, my, width);                                                   \
+    }
+
+PUT_CACHED(put_hevc_qpel_h, UHD_MC_CACHE_QPEL)
+PUT_CACHED(put_hevc_qpel_v, UHD_MC_CACHE_QPEL)
+PUT_CACHED(put_hevc_qpel_hv, UHD_MC_CACHE_QPEL)
+PUT_CACHED(put_hevc_epel_h, UHD_MC_CACHE_EPEL)
+PUT_CACHED(put_hevc_epel_v, UHD_MC_CACHE_EPEL)
+PUT_CACHED(put_hevc_epel_hv, UHD_MC_CACHE_EPEL)
+
+#undef PUT_CACHED
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Subpel reference planes for encoder motion search. A UHDSubpelPlanes holds
+// the 15 fractional-position planes of one padded reference picture. Plane
+// frac = mx + 4 * my - 1 is the 14-bit put_hevc_qpel output at quarter-sample
+// offset (mx, my). The planes cover the picture and its padding, less the
+// filter taps, so a search may look UHD_SUBPEL_BORDER samples past each edge.
+// They are stored in 64x64 tiles laid out from (-UHD_SUBPEL_BORDER,
+// -UHD_SUBPEL_BORDER), and each tile is interpolated on first use. Memory is
+// only spent where the search looks.
+// Any number of threads may read at once: a tile computed twice by a race is
+// dropped by the thread that loses the install. uhd_subpel_prefill spreads
+// whole planes over the threads of a pool instead.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef UHD_SUBPEL_PLANES
+#define UHD_SUBPEL_PLANES
+
+#define UHD_SUBPEL_NB_FRAC 15
+#define UHD_SUBPEL_TILE MAX_PB_SIZE // one put_hevc_qpel call per tile
+// readable border around the picture: the padding the qpel taps leave over
+#define UHD_SUBPEL_BORDER (UHD_FRAME_PADDING - QPEL_EXTRA_AFTER)
+
+typedef struct UHDSubpelPlanes
+{
+    const uint8_t *data; // first picture sample, padded by uhd_pad_frame
+    ptrdiff_t linesize;
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    int16_t **tile; // [frac][tile row][tile column], NULL until interpolated
+    void (*fill)(const struct UHDSubpelPlanes *p, int frac, int tx, int ty, int16_t *dst);
+} UHDSubpelPlanes;
+
+static void uhd_subpel_free(UHDSubpelPlanes *p)
+{
+    int i;
+
+    if (p->tile)
     {
-        for (x = 0; x < width; x++)
+        for (i = 0; i < UHD_SUBPEL_NB_FRAC * p->tiles_x * p->tiles_y; i++)
         {
-            dst[x] = uhd_clip_pixel((((EPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) * wx + offset) >> shift) + ox);
+            free(p->tile[i]);
         }
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
+        free(p->tile);
+        p->tile = NULL;
     }
 }
 
-static void FUNC(put_hevc_epel_bi_w_hv)(uint8_t *_dst, ptrdiff_t _dststride, uint8_t *_src, ptrdiff_t _srcstride,
-                                        int16_t *src2,
-                                        int height, int denom, int wx0, int wx1,
-                                        int ox0, int ox1, intptr_t mx, intptr_t my, int width)
+// the tile of plane frac at tile column tx and row ty, interpolating it if
+// no thread has yet; NULL on allocation failure
+static const int16_t *uhd_subpel_tile(const UHDSubpelPlanes *p, int frac, int tx, int ty)
 {
-    int x, y;
-    pixel *src = (pixel *)_src;
-    ptrdiff_t srcstride = _srcstride / sizeof(pixel);
-    pixel *dst = (pixel *)_dst;
-    ptrdiff_t dststride = _dststride / sizeof(pixel);
-    const int8_t *filter = uhd_hevc_epel_filters[mx - 1];
-    int16_t tmp_array[(MAX_PB_SIZE + EPEL_EXTRA) * MAX_PB_SIZE];
-    int16_t *tmp = tmp_array;
-    int shift = 14 + 1 - BIT_DEPTH;
-    int log2Wd = denom + shift - 1;
+    int16_t **slot = &p->tile[(frac * p->tiles_y + ty) * p->tiles_x + tx];
+    int16_t *t = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    int16_t *expected = NULL;
 
-    src -= EPEL_EXTRA_BEFORE * srcstride;
+    if (t)
+    {
+        return t;
+    }
+    t = (int16_t *)malloc(UHD_SUBPEL_TILE * UHD_SUBPEL_TILE * sizeof(int16_t));
+    if (!t)
+    {
+        return NULL;
+    }
+    p->fill(p, frac, tx, ty, t);
+    if (!__atomic_compare_exchange_n(slot, &expected, t, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        free(t);
+        t = expected;
+    }
+    return t;
+}
 
-    for (y = 0; y < height + EPEL_EXTRA; y++)
+// Copies the w x h block of plane frac at integer position (x, y) to dst.
+// The block may reach UHD_SUBPEL_BORDER samples past the picture edges and
+// reads the interpolated padding there. Returns -1 if it reaches further, or
+// on allocation failure.
+static int uhd_subpel_read(const UHDSubpelPlanes *p, int frac, int x, int y, int w, int h,
+                           int16_t *dst, ptrdiff_t dststride)
+{
+    int i, j;
+
+    if (uhd_mc_needs_edge_emu(x, y, w, h, p->width, p->height, UHD_SUBPEL_BORDER))
     {
-        for (x = 0; x < width; x++)
+        return -1;
+    }
+    for (j = 0; j < h; j++)
+    {
+        int sy = y + j + UHD_SUBPEL_BORDER;
+        int16_t *row = dst + j * dststride;
+
+        for (i = 0; i < w;)
         {
-            tmp[x] = EPEL_FILTER(src, 1) >> (BIT_DEPTH - 8);
+            int sx = x + i + UHD_SUBPEL_BORDER;
+            const int16_t *t = uhd_subpel_tile(p, frac, sx / UHD_SUBPEL_TILE, sy / UHD_SUBPEL_TILE);
+            int n = UHDMIN(w - i, UHD_SUBPEL_TILE - sx % UHD_SUBPEL_TILE);
+
+            if (!t)
+            {
+                return -1;
+            }
+            memcpy(row + i, t + sy % UHD_SUBPEL_TILE * UHD_SUBPEL_TILE + sx % UHD_SUBPEL_TILE,
+                   n * sizeof(int16_t));
+            i += n;
         }
-        src += srcstride;
-        tmp += MAX_PB_SIZE;
     }
+    return 0;
+}
 
-    tmp = tmp_array + EPEL_EXTRA_BEFORE * MAX_PB_SIZE;
-    filter = uhd_hevc_epel_filters[my - 1];
+// Interpolates every tile row job, job + nb_jobs, ... of all planes; run it
+// with job = 0 .. nb_jobs - 1 on as many threads. Returns -1 on allocation
+// failure.
+static int uhd_subpel_prefill(const UHDSubpelPlanes *p, int job, int nb_jobs)
+{
+    int frac, tx, ty;
 
-    ox0 = ox0 * (1 << (BIT_DEPTH - 8));
-    ox1 = ox1 * (1 << (BIT_DEPTH - 8));
-    for (y = 0; y < height; y++)
+    for (ty = job; ty < p->tiles_y; ty += nb_jobs)
     {
-        for (x = 0; x < width; x++)
-            dst[x] = uhd_clip_pixel(((EPEL_FILTER(tmp, MAX_PB_SIZE) >> 6) * wx1 + src2[x] * wx0 +
-                                     ((ox0 + ox1 + 1) << log2Wd)) >>
-                                    (log2Wd + 1));
-        tmp += MAX_PB_SIZE;
-        dst += dststride;
-        src2 += MAX_PB_SIZE;
+        for (frac = 0; frac < UHD_SUBPEL_NB_FRAC; frac++)
+        {
+            for (tx = 0; tx < p->tiles_x; tx++)
+            {
+                if (!uhd_subpel_tile(p, frac, tx, ty))
+                {
+                    return -1;
+                }
+            }
+        }
     }
-} // line zero
+    return 0;
+}
+#endif
+
+// The last tile column and row are cut at the readable border, so the taps
+// never leave the UHD_FRAME_PADDING border; their remaining samples are
+// never read.
+static void FUNC(uhd_subpel_fill_tile)(const UHDSubpelPlanes *p, int frac, int tx, int ty, int16_t *dst)
+{
+    int mx = (frac + 1) & 3;
+    int my = (frac + 1) >> 2;
+    int x0 = tx * UHD_SUBPEL_TILE - UHD_SUBPEL_BORDER;
+    int y0 = ty * UHD_SUBPEL_TILE - UHD_SUBPEL_BORDER;
+    int w = UHDMIN(UHD_SUBPEL_TILE, p->width + UHD_SUBPEL_BORDER - x0);
+    int h = UHDMIN(UHD_SUBPEL_TILE, p->height + UHD_SUBPEL_BORDER - y0);
+    uint8_t *src = (uint8_t *)p->data + y0 * p->linesize + x0 * (ptrdiff_t)sizeof(pixel);
+
+    if (!my)
+    {
+        FUNC(put_hevc_qpel_h)(dst, src, p->linesize, h, mx, 0, w);
+    }
+    else if (!mx)
+    {
+        FUNC(put_hevc_qpel_v)(dst, src, p->linesize, h, 0, my, w);
+    }
+    else
+    {
+        FUNC(put_hevc_qpel_hv)(dst, src, p->linesize, h, mx, my, w);
+    }
+}
+
+// Sets p up over the width x height picture at data, which uhd_pad_frame
+// has padded by UHD_FRAME_PADDING; no tile is interpolated yet. Returns -1 on
+// allocation failure.
+static int FUNC(uhd_subpel_init)(UHDSubpelPlanes *p, const uint8_t *data, ptrdiff_t linesize,
+                                 int width, int height)
+{
+    p->data = data;
+    p->linesize = linesize;
+    p->width = width;
+    p->height = height;
+    p->tiles_x = (width + 2 * UHD_SUBPEL_BORDER + UHD_SUBPEL_TILE - 1) / UHD_SUBPEL_TILE;
+    p->tiles_y = (height + 2 * UHD_SUBPEL_BORDER + UHD_SUBPEL_TILE - 1) / UHD_SUBPEL_TILE;
+    p->fill = FUNC(uhd_subpel_fill_tile);
+    p->tile = (int16_t **)calloc(UHD_SUBPEL_NB_FRAC * p->tiles_x * p->tiles_y, sizeof(*p->tile));
+    return p->tile ? 0 : -1;
+}
+
 #define P3 pix[-4 * xstride]
 #define P2 pix[-3 * xstride]
 #define P1 pix[-2 * xstride]
@@ -2774,6 +7309,38 @@ static void FUNC(hevc_v_loop_filter_luma)(uint8_t *pix, ptrdiff_t stride,
      beta, tc, no_p, no_q);
 }
 
+#ifdef UHD_KERNEL_PROFILE
+// A deblocking call filters one 8-sample edge as two 4-line segments; the
+// block is the area it reads (8 along the edge, 4 or 2 on each side), and
+// mx holds which of the two segments have a nonzero tc.
+#define LOOP_FILTER_PROF(name, w, h)                                                             \
+    static void FUNC(name##_prof)(uint8_t * pix, ptrdiff_t stride, int32_t *tc,                  \
+                                  uint8_t *no_p, uint8_t *no_q)                                  \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(name)(pix, stride, tc, no_p, no_q);                                                 \
+        uhd_prof_add(#name, BIT_DEPTH, w, h, (tc[0] != 0) | (tc[1] != 0) << 1, 0, start);        \
+    }
+#define LOOP_FILTER_PROF_LUMA(name, w, h)                                                        \
+    static void FUNC(name##_prof)(uint8_t * pix, ptrdiff_t stride, int beta, int32_t *tc,        \
+                                  uint8_t *no_p, uint8_t *no_q)                                  \
+    {                                                                                            \
+        uint64_t start = uhd_ticks();                                                            \
+                                                                                                 \
+        FUNC(name)(pix, stride, beta, tc, no_p, no_q);                                           \
+        uhd_prof_add(#name, BIT_DEPTH, w, h, (tc[0] != 0) | (tc[1] != 0) << 1, 0, start);        \
+    }
+
+LOOP_FILTER_PROF(hevc_h_loop_filter_chroma, 8, 4)
+LOOP_FILTER_PROF(hevc_v_loop_filter_chroma, 4, 8)
+LOOP_FILTER_PROF_LUMA(hevc_h_loop_filter_luma, 8, 8)
+LOOP_FILTER_PROF_LUMA(hevc_v_loop_filter_luma, 8, 8)
+
+#undef LOOP_FILTER_PROF
+#undef LOOP_FILTER_PROF_LUMA
+#endif
+
 #undef P3
 #undef P2
 #undef P1